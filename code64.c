@@ -4,9 +4,33 @@
 #include <stdlib.h>   // for atoi();
 #include <string.h>   // memset(), strerror()
 #include <errno.h>    // make available the global errno variable
+#include <ctype.h>    // for isalnum()
+#include <pthread.h>  // for the --batch workers
+#include <stdatomic.h>
+#include <unistd.h>   // for sysconf()
+#include <sys/stat.h> // for mkdir()
+#include <sys/mman.h> // for --mmap
+#include <fcntl.h>    // for fcntl(), to map the output of --large
 
 #include "code64.h"
 
+typedef struct _Radix_Type
+{
+   const char *name;
+   C64_Radix radix;
+   unsigned int group_chars;  // line lengths are rounded down to a multiple
+   const char *suffix;        // of the files encoded by --batch
+} Radix_Type;
+
+Radix_Type radix_types[] = {
+   { "base64",    C64_BASE64,    4, ".b64" },
+   { "base32",    C64_BASE32,    8, ".b32" },
+   { "base32hex", C64_BASE32HEX, 8, ".b32" },
+   { "base16",    C64_BASE16,    2, ".b16" }
+};
+
+unsigned int number_of_radix_types = sizeof(radix_types) / sizeof(Radix_Type);
+
 typedef struct _Std_Type
 {
    const char *name;
@@ -38,6 +62,12 @@ void show_standards(void)
    }
 }
 
+void show_radixes(void)
+{
+   for (unsigned int i=0; i < number_of_radix_types; ++i)
+      printf("   %s\n", radix_types[i].name);
+}
+
 void show_usage(void)
 {
    printf("-b line length  Number of characters per line in encoded output.\n");
@@ -45,11 +75,36 @@ void show_usage(void)
    printf("-d to decode file.\n");
    printf("-e to encode file without breaks.\n");
    printf("-h *help* to show usage (this display).\n");
+   printf("-x to decode every PEM or MIME base64 block of the input to separate files.\n");
+   printf("   The files are named with the -o value as a prefix (default \"block-\"),\n");
+   printf("   a sequence number, and the label of the block.\n");
    printf("-i filename Read filename instead of reading stdin for input.\n");
+   printf("-j threads Encode or decode with a reader thread, this number of converting threads,\n");
+   printf("   and a writer thread.  0 picks the number of threads from the processors.\n");
+   printf("-k print the CRC32C checksum of the unencoded data to stderr.\n");
+   printf("-K checksum Verify the CRC32C checksum (hexadecimal) of the unencoded data.\n");
    printf("-o filename Write to filename instead to stdout.\n");
+   printf("-z Compress with gzip before encoding, or decompress after decoding with -d.\n");
+   printf("--check Verify that the input is well-formed without decoding it, and print\n");
+   printf("   the exact number of bytes it decodes to.  Exits with 1 if it is not valid.\n");
+   printf("--mmap Map the input file into memory and write the output without stdio buffering.\n");
+   printf("--large Like --mmap, and map an output file too, writing it with non-temporal stores\n");
+   printf("   that bypass the cache, to spare the cache of other programs on the host.\n");
+   printf("--batch Encode or decode every input file named, or every file listed on stdin\n");
+   printf("   if none are named, with -j workers.  Each result is written to the input name\n");
+   printf("   with \".b64\" added (or removed to decode), in the -o directory if given.\n");
+   printf("--range first:last With -d, decode only bytes [first, last) of the original data.\n");
+   printf("   Omit last to decode to the end.  The input must be a file.\n");
+   printf("--index filename Use the index in filename to find the start of --range.\n");
+   printf("--make-index filename Write an index of the encoded input for --range to filename.\n");
+   printf("-t from:to Translate encoded input from one standard to another without decoding.\n");
+   printf("-r radix Encoding to use instead of base64.\n");
+   printf("   The following encodings are recognized:\n");
+   show_radixes();
    printf("-s standard to use for special characters, padding, and line length.\n");
    printf("   The following standards are recognized:\n");
    show_standards();
+   printf("   With -d, \"auto\" picks the standard by the special characters of the input.\n");
 }
 
 void close_FILEs(FILE *file1, FILE *file2)
@@ -84,6 +139,145 @@ const Std_Type* get_standard(const char *sname)
    return 0;
 }
 
+/**
+ * @brief Report the special characters chosen by -s auto, and the
+ *        names of the standards that use them.
+ */
+void show_detected(const char *specials)
+{
+   const char *separator = "";
+
+   fprintf(stderr, "Detected special characters \"%s\" (", specials);
+   for (unsigned int i=0; i < number_of_bstypes; ++i)
+   {
+      if (0 == strcmp(bstypes[i].specials, specials))
+      {
+         fprintf(stderr, "%s%s", separator, bstypes[i].name);
+         separator = ", ";
+      }
+   }
+   fprintf(stderr, ").\n");
+}
+
+const Radix_Type* get_radix(const char *rname)
+{
+   for (unsigned int i=0; i < number_of_radix_types; ++i)
+   {
+      if (0 == strcmp(radix_types[i].name, rname))
+         return &radix_types[i];
+   }
+   return 0;
+}
+
+/**
+ * @brief Set the source and target standards from a "from:to" argument.
+ *
+ * @return 1 if both standard names are recognized, otherwise 0.
+ */
+int get_transcode_standards(const char *arg, const Std_Type **from, const Std_Type **to)
+{
+   char from_name[32];
+   const char *colon = strchr(arg, ':');
+
+   if (!colon || (size_t)(colon - arg) >= sizeof(from_name))
+      return 0;
+
+   memcpy(from_name, arg, colon - arg);
+   from_name[colon - arg] = '\0';
+
+   *from = get_standard(from_name);
+   *to = get_standard(colon + 1);
+
+   return *from && *to;
+}
+
+/**
+ * @brief State of the c64_extract_blocks() callback for the -x option.
+ */
+typedef struct _Extract_Target
+{
+   const char *prefix;
+   unsigned int index;
+   FILE *file;
+   char filename[512];
+   size_t written;
+   int failed;
+} Extract_Target;
+
+/**
+ * @brief Block_User callback that writes each block to a new file.
+ *
+ * Characters of the label that may not be safe in a file name
+ * are replaced with '_'.
+ */
+void write_extracted_block(void *user_data, C64_Block_Event event, const char *label,
+                           const void *data, size_t data_length)
+{
+   Extract_Target *target = (Extract_Target*)user_data;
+
+   switch(event)
+   {
+      case C64_BLOCK_BEGIN:
+      {
+         int len = snprintf(target->filename, sizeof(target->filename), "%s%04u-%s",
+                            target->prefix, ++target->index, label);
+         if (len >= (int)sizeof(target->filename))
+            len = sizeof(target->filename) - 1;
+
+         for (char *ptr = target->filename + strlen(target->prefix); ptr < target->filename + len; ++ptr)
+            if (!isalnum((unsigned char)*ptr) && !strchr(".-_", *ptr))
+               *ptr = '_';
+
+         target->written = 0;
+         target->file = fopen(target->filename, "w");
+         if (!target->file)
+         {
+            fprintf(stderr, "Failed to open out file \"%s\" (%s).\n", target->filename, strerror(errno));
+            target->failed = 1;
+         }
+         break;
+      }
+      case C64_BLOCK_DATA:
+         if (target->file)
+            target->written += fwrite(data, 1, data_length, target->file);
+         break;
+      case C64_BLOCK_END:
+         if (target->file)
+         {
+            fclose(target->file);
+            target->file = NULL;
+            fprintf(stderr, "Wrote %s (%lu bytes).\n", target->filename, target->written);
+         }
+         break;
+   }
+}
+
+/**
+ * @brief Parse a "first:last" byte range.  An empty last means to the end (-1).
+ *
+ * @return 1 for a valid range, otherwise 0.
+ */
+int parse_range(const char *arg, off_t *first, off_t *last)
+{
+   char *end;
+
+   *first = strtoll(arg, &end, 10);
+   if (end == arg || *end != ':' || *first < 0)
+      return 0;
+
+   arg = end + 1;
+   if (*arg == '\0')
+      *last = -1;
+   else
+   {
+      *last = strtoll(arg, &end, 10);
+      if (*end != '\0' || *last < *first)
+         return 0;
+   }
+
+   return 1;
+}
+
 /**
  * @brief Return a valid breaks value (divisble by 4).  Returns 0 if less than 3.
  */
@@ -96,9 +290,334 @@ int align_breaks_value(const char *val)
       return 0;
 }
 
+/** Size of each of the stdio buffers that a --batch worker reuses for every file. */
+#define BATCH_BUFFER_SIZE (64 * 1024)
+
+/**
+ * @brief Files and settings of a --batch run, shared by its workers.
+ *
+ * Each worker takes the next file by incrementing *next*, so the files
+ * are converted in parallel without any locking.
+ */
+typedef struct _Batch
+{
+   const char **files;
+   unsigned int count;
+   atomic_uint next;
+   atomic_uint failed;
+   int decoding;
+   const Radix_Type *radix;
+   int breaks;
+   int use_crc;
+   const char *out_dir;      // NULL to write next to each input
+} Batch;
+
+/**
+ * @brief Make the output file name of *in_name* for a --batch run.
+ *
+ * Encoding appends the suffix of the radix, ".b64" for base64.
+ * Decoding removes that suffix, or appends ".decoded" if it is missing.
+ * With an output directory, the name is placed there instead of next to
+ * the input.
+ *
+ * @return 1 on success, 0 if the name does not fit in *buffer*.
+ */
+int batch_output_name(const Batch *batch, const char *in_name, char *buffer, size_t bufflen)
+{
+   const char *suffix = batch->radix->suffix;
+   const char *name = in_name;
+   size_t len = strlen(in_name);
+   size_t len_suffix = strlen(suffix);
+   int written;
+
+   if (batch->out_dir)
+   {
+      const char *slash = strrchr(in_name, '/');
+      if (slash)
+      {
+         name = slash + 1;
+         len -= name - in_name;
+      }
+   }
+
+   if (!batch->decoding)
+      written = snprintf(buffer, bufflen, "%s%s%.*s%s",
+                         batch->out_dir ? batch->out_dir : "", batch->out_dir ? "/" : "",
+                         (int)len, name, suffix);
+   else if (len > len_suffix && 0 == strcmp(name + len - len_suffix, suffix))
+      written = snprintf(buffer, bufflen, "%s%s%.*s",
+                         batch->out_dir ? batch->out_dir : "", batch->out_dir ? "/" : "",
+                         (int)(len - len_suffix), name);
+   else
+      written = snprintf(buffer, bufflen, "%s%s%.*s.decoded",
+                         batch->out_dir ? batch->out_dir : "", batch->out_dir ? "/" : "",
+                         (int)len, name);
+
+   return written >= 0 && (size_t)written < bufflen;
+}
+
+/**
+ * @brief Convert one file of a --batch run.
+ *
+ * The worker's buffers replace the ones stdio would allocate for every
+ * file it opens.
+ *
+ * @return 1 on success, otherwise 0 after reporting the problem.
+ */
+int batch_convert(const Batch *batch, const char *in_name, char *inbuff, char *outbuff)
+{
+   char out_name[4096];
+   uint32_t crc = 0;
+   int success = 1;
+
+   if (!batch_output_name(batch, in_name, out_name, sizeof(out_name)))
+   {
+      fprintf(stderr, "Output file name for \"%s\" is too long.\n", in_name);
+      return 0;
+   }
+
+   FILE *fin = fopen(in_name, "r");
+   if (!fin)
+   {
+      fprintf(stderr, "Failed to open input file \"%s\" (%s).\n", in_name, strerror(errno));
+      return 0;
+   }
+
+   FILE *fout = fopen(out_name, "w");
+   if (!fout)
+   {
+      fprintf(stderr, "Failed to open out file \"%s\" (%s).\n", out_name, strerror(errno));
+      fclose(fin);
+      return 0;
+   }
+
+   setvbuf(fin, inbuff, _IOFBF, BATCH_BUFFER_SIZE);
+   setvbuf(fout, outbuff, _IOFBF, BATCH_BUFFER_SIZE);
+
+   if (batch->decoding)
+      c64_radix_decode_stream_to_stream(batch->radix->radix, fin, fout, batch->use_crc ? &crc : NULL);
+   else
+      c64_radix_encode_stream_to_stream(batch->radix->radix, fin, fout, batch->breaks,
+                                        batch->use_crc ? &crc : NULL);
+
+   if (ferror(fin))
+   {
+      fprintf(stderr, "Failed to read input file \"%s\".\n", in_name);
+      success = 0;
+   }
+
+   if (fclose(fout) != 0)
+   {
+      fprintf(stderr, "Failed to write out file \"%s\" (%s).\n", out_name, strerror(errno));
+      success = 0;
+   }
+
+   fclose(fin);
+
+   if (success && batch->use_crc)
+      fprintf(stderr, "CRC32C %s: %08x\n", in_name, crc);
+
+   return success;
+}
+
+/**
+ * @brief Worker thread of a --batch run: convert files until none are left.
+ */
+void *batch_worker(void *arg)
+{
+   Batch *batch = (Batch*)arg;
+   // If either allocation fails, stdio allocates that buffer per file:
+   char *inbuff = (char*)malloc(BATCH_BUFFER_SIZE);
+   char *outbuff = (char*)malloc(BATCH_BUFFER_SIZE);
+   unsigned int index;
+
+   while ((index = atomic_fetch_add(&batch->next, 1)) < batch->count)
+      if (!batch_convert(batch, batch->files[index], inbuff, outbuff))
+         atomic_fetch_add(&batch->failed, 1);
+
+   free(inbuff);
+   free(outbuff);
+   return NULL;
+}
+
+/**
+ * @brief Read the names of the files for --batch from *in*, one per line.
+ *
+ * The names are added to *files*, which is reallocated as needed, and
+ * *count* is updated to match.  On failure, *files* still holds the
+ * names read so far.
+ *
+ * @return 0 on success, -1 if memory ran out.
+ */
+int read_file_list(FILE *in, const char ***files, unsigned int *count)
+{
+   unsigned int capacity = *count;
+   char *line = NULL;
+   size_t len_line = 0;
+   ssize_t len;
+   int result = 0;
+
+   while ((len = getline(&line, &len_line, in)) >= 0)
+   {
+      while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+         line[--len] = '\0';
+      if (len == 0)
+         continue;
+
+      if (*count == capacity)
+      {
+         unsigned int grown = capacity ? capacity * 2 : 256;
+         const char **larger = (const char**)realloc(*files, grown * sizeof(const char*));
+         if (!larger)
+         {
+            result = -1;
+            break;
+         }
+         *files = larger;
+         capacity = grown;
+      }
+
+      const char *name = strdup(line);
+      if (!name)
+      {
+         result = -1;
+         break;
+      }
+      (*files)[(*count)++] = name;
+   }
+
+   free(line);
+   return result;
+}
+
+/**
+ * @brief Convert every file of *batch* with a pool of *threads* workers.
+ *
+ * @return Number of files that failed.
+ */
+unsigned int run_batch(Batch *batch, int threads)
+{
+   if (threads <= 0)
+   {
+      long cores = sysconf(_SC_NPROCESSORS_ONLN);
+      threads = cores > 0 ? cores : 1;
+   }
+   if ((unsigned int)threads > batch->count)
+      threads = batch->count ? batch->count : 1;
+
+   if (batch->out_dir && mkdir(batch->out_dir, 0777) != 0 && errno != EEXIST)
+   {
+      fprintf(stderr, "Failed to make output directory \"%s\" (%s).\n", batch->out_dir, strerror(errno));
+      return batch->count;
+   }
+
+   pthread_t *workers = (pthread_t*)calloc(threads, sizeof(pthread_t));
+   int started = 0;
+
+   for (; workers && started < threads; ++started)
+      if (pthread_create(&workers[started], NULL, batch_worker, batch))
+         break;
+
+   // With no threads at all, do the work on this one:
+   if (started == 0)
+      batch_worker(batch);
+
+   for (int i = 0; i < started; ++i)
+      pthread_join(workers[i], NULL);
+
+   free(workers);
+   return atomic_load(&batch->failed);
+}
+
+/**
+ * @brief Encode or decode for --mmap: the input file is mapped into
+ *        memory and converted where it is, and the output is written
+ *        straight to its file descriptor, with no stdio in between.
+ *
+ * Input that cannot be mapped, like a pipe, is read from its file
+ * descriptor instead.  For --large, an output file is mapped as well,
+ * and written with non-temporal stores that bypass the cache.
+ *
+ * @return 0 on success, -1 if reading or writing failed.
+ */
+int convert_mapped(FILE *in, FILE *out, C64_Radix radix, int decoding, int breaks, int large, uint32_t *crc)
+{
+   int in_fd = fileno(in);
+   struct stat st;
+   void *map = MAP_FAILED;
+   C64_Memory memory = { NULL, 0, 0, 0 };
+   C64_Reader reader;
+
+   if (fstat(in_fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+      map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, in_fd, 0);
+
+   if (map != MAP_FAILED)
+   {
+      madvise(map, st.st_size, MADV_SEQUENTIAL);
+      memory.data = (char*)map;
+      memory.size = st.st_size;
+      reader = c64_memory_reader(&memory);
+   }
+   else
+      reader = c64_fd_reader(in_fd);
+
+   int out_fd = fileno(out);
+   C64_Writer writer = c64_fd_writer(out_fd);
+   C64_Memory target = { NULL, 0, 0, 0 };
+   struct stat out_st;
+
+   // Only an output open for reading and writing, at its start, can be
+   // mapped; a redirected stdout is usually open for writing only:
+   int out_flags = fcntl(out_fd, F_GETFL);
+
+   if (large && map != MAP_FAILED && fstat(out_fd, &out_st) == 0 && S_ISREG(out_st.st_mode)
+       && out_flags >= 0 && (out_flags & O_ACCMODE) == O_RDWR && !(out_flags & O_APPEND)
+       && lseek(out_fd, 0, SEEK_CUR) == 0)
+   {
+      // Map enough for the longest possible output, to be trimmed after:
+      size_t bound = decoding
+         ? c64_radix_decode_chars_needed(radix, st.st_size)
+         : c64_radix_encode_chars_needed(radix, st.st_size);
+      if (!decoding && breaks)
+         bound += (bound / breaks + 1) * 2;
+
+      void *out_map = MAP_FAILED;
+      if (ftruncate(out_fd, bound) == 0)
+         out_map = mmap(NULL, bound, PROT_READ | PROT_WRITE, MAP_SHARED, out_fd, 0);
+
+      if (out_map != MAP_FAILED)
+      {
+         target.data = (char*)out_map;
+         target.size = bound;
+         writer = c64_memory_writer(&target);
+      }
+      else if (ftruncate(out_fd, out_st.st_size))
+      {
+         munmap(map, st.st_size);
+         return -1;
+      }
+   }
+
+   int result = decoding
+      ? c64_radix_decode_reader_to_writer(radix, reader, writer, crc)
+      : c64_radix_encode_reader_to_writer(radix, reader, writer, breaks, crc);
+
+   if (map != MAP_FAILED)
+      munmap(map, st.st_size);
+
+   if (target.data)
+   {
+      munmap(target.data, target.size);
+      if (ftruncate(out_fd, target.position))
+         result = -1;
+   }
+
+   return result;
+}
+
 int main(int argc, const char **argv)
 {
-   enum ops { None, Encode, Decode };
+   enum ops { None, Encode, Decode, Transcode, Extract, Make_Index, Check };
 
    // FILE stream pointers to be used for input and output.
    // Although they may point to different streams, they will
@@ -125,9 +644,52 @@ int main(int argc, const char **argv)
 
    const Std_Type *selected_stype = NULL;
 
+   // Set by -s auto to pick the standard of input to decode by its characters:
+   int use_auto = 0;
+
+   // Set by --range, --index and --make-index:
+   const char *range_arg = NULL;
+   const char *index_filename = NULL;
+   off_t range_first = 0, range_last = -1;
+   const Radix_Type *selected_radix = &radix_types[0];
+
+   // Source and target standards for -t:
+   const Std_Type *from_stype = NULL;
+   const Std_Type *to_stype = NULL;
+
    enum ops operation = Encode;
    int breaks = 76;
 
+   // Set by -k or -K to compute the CRC32C of the unencoded data
+   // while converting.  -K also sets the expected checksum value.
+   int use_crc = 0;
+   const char *expected_crc = NULL;
+   uint32_t crc = 0;
+
+   // Set by -j to the number of converting threads of a pipelined stream,
+   // or with --batch, to the number of files converted at once:
+   int threads = -1;
+
+   // Set by -z to compress before encoding, or decompress after decoding:
+   int use_zlib = 0;
+
+   // Set by --mmap to map the input and write the output without stdio,
+   // and by --large to also map the output and bypass the cache:
+   int use_mmap = 0;
+   int use_large = 0;
+
+   // Set by --batch.  Every input file named on the command line is
+   // collected, rather than only the last one:
+   int batch_mode = 0;
+   const char **batch_files = (const char**)calloc(argc, sizeof(const char*));
+   unsigned int batch_count = 0;
+
+   if (!batch_files)
+   {
+      fprintf(stderr, "Failed to allocate the file list (%s).\n", strerror(errno));
+      return 1;
+   }
+
    if (argc == 1)
    {
       show_usage();
@@ -142,11 +704,50 @@ int main(int argc, const char **argv)
          {
             // If not an option, assume the argument is the infile name:
             if (**ptr != '-')
-               in_filename = *ptr;
+               in_filename = batch_files[batch_count++] = *ptr;
             else
             {
                switch((*ptr)[1])
                {
+                  case '-':
+                     if (0 == strcmp(*ptr, "--range"))
+                     {
+                        ++ptr;
+                        ++count;
+                        range_arg = *ptr;
+                        if (!range_arg || !parse_range(range_arg, &range_first, &range_last))
+                        {
+                           fprintf(stderr, "Invalid range '%s', expected first:last.\n", range_arg);
+                           return 1;
+                        }
+                     }
+                     else if (0 == strcmp(*ptr, "--index"))
+                     {
+                        ++ptr;
+                        ++count;
+                        index_filename = *ptr;
+                     }
+                     else if (0 == strcmp(*ptr, "--check"))
+                        operation = Check;
+                     else if (0 == strcmp(*ptr, "--batch"))
+                        batch_mode = 1;
+                     else if (0 == strcmp(*ptr, "--mmap"))
+                        use_mmap = 1;
+                     else if (0 == strcmp(*ptr, "--large"))
+                        use_mmap = use_large = 1;
+                     else if (0 == strcmp(*ptr, "--make-index"))
+                     {
+                        ++ptr;
+                        ++count;
+                        index_filename = *ptr;
+                        operation = Make_Index;
+                     }
+                     else
+                     {
+                        show_usage();
+                        return 1;
+                     }
+                     break;
                   case 'b':
                      ++ptr;
                      ++count;
@@ -171,20 +772,56 @@ int main(int argc, const char **argv)
                   case 'h':
                      show_usage();
                      return 0;
+                  case 'x':
+                     operation = Extract;
+                     break;
                   case 'i':
                      ++ptr;
                      ++count;
-                     in_filename = *ptr;
+                     if (*ptr)
+                        in_filename = batch_files[batch_count++] = *ptr;
+                     break;
+                  case 'j':
+                     ++ptr;
+                     ++count;
+                     if (!*ptr || (threads = atoi(*ptr)) < 0)
+                     {
+                        fprintf(stderr, "Invalid number of threads '%s'.\n", *ptr);
+                        return 1;
+                     }
+                     break;
+                  case 'k':
+                     use_crc = 1;
+                     break;
+                  case 'K':
+                     ++ptr;
+                     ++count;
+                     use_crc = 1;
+                     expected_crc = *ptr;
+                     break;
+                  case 'z':
+                     use_zlib = 1;
                      break;
                   case 'o':
                      ++ptr;
                      ++count;
                      out_filename = *ptr;
                      break;
+                  case 'r':
+                     ++ptr;
+                     ++count;
+                     if (!(selected_radix = get_radix(*ptr)))
+                     {
+                        fprintf(stderr, "Unrecognized encoding name '%s'.\n", *ptr);
+                        return 1;
+                     }
+                     break;
                   case 's':
                      ++ptr;
                      ++count;
-                     if ((selected_stype = get_standard(*ptr)))
+                     if (*ptr && 0 == strcmp(*ptr, "auto"))
+                        use_auto = 1;
+                     else if ((selected_stype = get_standard(*ptr)))
                      {
                         set_special_chars_from_string(selected_stype->specials);
                         breaks = selected_stype->breaks;
@@ -192,6 +829,20 @@ int main(int argc, const char **argv)
                      else
                         fprintf(stderr, "Unrecognized standard name '%s'.\n", *ptr);
                      break;
+                  case 't':
+                     ++ptr;
+                     ++count;
+                     if (get_transcode_standards(*ptr, &from_stype, &to_stype))
+                     {
+                        operation = Transcode;
+                        breaks = to_stype->breaks;
+                     }
+                     else
+                     {
+                        fprintf(stderr, "Unrecognized standards '%s', expected from:to.\n", *ptr);
+                        return 1;
+                     }
+                     break;
                   default:
                      show_usage();
                      return 1;
@@ -203,6 +854,66 @@ int main(int argc, const char **argv)
          ++ptr;
       }
 
+      if (use_auto && (operation != Decode || selected_radix->radix != C64_BASE64
+                       || batch_mode || range_arg || use_zlib || use_mmap || threads >= 0))
+      {
+         fprintf(stderr, "-s auto only decodes base64 with -d, without -j, -z, --mmap, --batch or --range.\n");
+         return 1;
+      }
+
+      if ((range_arg || (index_filename && operation != Make_Index))
+          && (operation != Decode || !range_arg))
+      {
+         fprintf(stderr, "--range only decodes with -d, and --index needs --range.\n");
+         return 1;
+      }
+
+      if ((range_arg || operation == Make_Index) && selected_radix->radix != C64_BASE64)
+      {
+         fprintf(stderr, "--range, --index and --make-index only work with base64.\n");
+         return 1;
+      }
+
+      if (use_crc && ((operation != Encode && operation != Decode) || range_arg))
+      {
+         fprintf(stderr, "-k and -K only check the data of a plain encode or decode, without --range.\n");
+         return 1;
+      }
+
+      if (batch_mode)
+      {
+         if (operation != Encode && operation != Decode)
+         {
+            fprintf(stderr, "--batch only encodes or decodes.\n");
+            return 1;
+         }
+         if (expected_crc)
+         {
+            fprintf(stderr, "-K cannot check the files of --batch, use -k to print their checksums.\n");
+            return 1;
+         }
+         if (use_zlib || use_mmap || range_arg)
+         {
+            fprintf(stderr, "--batch converts whole files without -z, --mmap, --large or --range.\n");
+            return 1;
+         }
+
+         // Without file names, read them from stdin:
+         if (batch_count == 0 && read_file_list(stdin, &batch_files, &batch_count))
+         {
+            fprintf(stderr, "Failed to read the file list (%s).\n", strerror(errno));
+            return 1;
+         }
+
+         Batch batch = { batch_files, batch_count, 0, 0, operation == Decode, selected_radix,
+                         breaks / selected_radix->group_chars * selected_radix->group_chars,
+                         use_crc, out_filename };
+         unsigned int failed = run_batch(&batch, threads);
+
+         fprintf(stderr, "Converted %u of %u files.\n", batch_count - failed, batch_count);
+         return failed ? 1 : 0;
+      }
+
       if (in_filename)
       {
          fin = fopen(in_filename, "r");
@@ -216,9 +927,10 @@ int main(int argc, const char **argv)
          }
       }
 
-      if (out_filename)
+      if (out_filename && operation != Extract && operation != Make_Index)
       {
-         fout = fopen(out_filename, "w");
+         // Mapping the output for --large needs it open for reading too:
+         fout = fopen(out_filename, use_large ? "w+" : "w");
          if (fout)
             fout_using = fout;
          else
@@ -229,12 +941,199 @@ int main(int argc, const char **argv)
          }
       }
 
-      if (operation == Encode)
-         c64_encode_stream_to_stream(fin_using, fout_using, breaks);
+      breaks = breaks / selected_radix->group_chars * selected_radix->group_chars;
+
+      if (range_arg && operation == Decode)
+      {
+         int result;
+         FILE *index = NULL;
+
+         if (index_filename && !(index = fopen(index_filename, "r")))
+         {
+            fprintf(stderr, "Failed to open index file \"%s\" (%s).\n", index_filename, strerror(errno));
+            close_FILEs(fin, fout);
+            return 1;
+         }
+
+         if (index)
+         {
+            result = c64_decode_range_indexed(fin_using, index, fout_using, range_first, range_last);
+            fclose(index);
+         }
+         else
+            result = c64_decode_range(fin_using, fout_using, range_first, range_last);
+
+         int write_failed = ferror(fout_using);
+         close_FILEs(fin, fout);
+
+         if (result)
+         {
+            if (write_failed)
+               fprintf(stderr, "Failed to write the output (%s).\n", strerror(errno));
+            else if (index_filename)
+               fprintf(stderr, "Failed to decode range %s: invalid index or unseekable input.\n", range_arg);
+            else
+               fprintf(stderr, "Failed to decode range %s: input is unseekable or its lines are irregular"
+                       " (see --make-index).\n", range_arg);
+            return 1;
+         }
+         return 0;
+      }
+      else if (operation == Make_Index)
+      {
+         FILE *index = fopen(index_filename, "w");
+         if (!index)
+         {
+            fprintf(stderr, "Failed to open index file \"%s\" (%s).\n", index_filename, strerror(errno));
+            close_FILEs(fin, fout);
+            return 1;
+         }
+
+         // An entry for every 48 KB of decoded data:
+         off_t entries = c64_build_index(fin_using, index, 3 * 16384);
+         int write_failed = ferror(index);
+         fclose(index);
+
+         if (entries < 0)
+         {
+            if (write_failed)
+               fprintf(stderr, "Failed to write index file \"%s\" (%s).\n", index_filename, strerror(errno));
+            else
+               fprintf(stderr, "Failed to index the input: it must be a file.\n");
+            close_FILEs(fin, fout);
+            return 1;
+         }
+         fprintf(stderr, "Wrote %ld index entries to %s.\n", (long)entries, index_filename);
+      }
+      else if (operation == Check)
+      {
+         uint64_t decoded_length, error_offset;
+
+         if (!c64_radix_check_stream(selected_radix->radix, fin_using, &decoded_length, &error_offset))
+         {
+            fprintf(stderr, "Invalid %s input at offset %llu.\n",
+                    selected_radix->name, (unsigned long long)error_offset);
+            close_FILEs(fin, fout);
+            return 1;
+         }
+         fprintf(fout_using, "%llu\n", (unsigned long long)decoded_length);
+      }
+      else if (use_auto)
+      {
+         // Choose among the standards by the special characters of the input:
+         const char *candidates[sizeof(bstypes) / sizeof(Std_Type)];
+         int detected;
+
+         for (unsigned int i=0; i < number_of_bstypes; ++i)
+            candidates[i] = bstypes[i].specials;
+
+         if (c64_decode_detected_reader_to_writer(c64_file_reader(fin_using), c64_file_writer(fout_using),
+                                                  candidates, number_of_bstypes, &detected,
+                                                  use_crc ? &crc : NULL))
+         {
+            fprintf(stderr, "Failed to decode the input (%s).\n", strerror(errno));
+            close_FILEs(fin, fout);
+            return 1;
+         }
+         show_detected(candidates[detected]);
+      }
+      else if (use_zlib && (operation == Encode || operation == Decode))
+      {
+         int result = operation == Encode
+            ? c64_encode_stream_to_stream_deflate(selected_radix->radix, fin_using, fout_using,
+                                                  breaks, -1, use_crc ? &crc : NULL)
+            : c64_decode_stream_to_stream_inflate(selected_radix->radix, fin_using, fout_using,
+                                                  use_crc ? &crc : NULL);
+         if (result)
+         {
+            if (result == -2)
+               fprintf(stderr, "-z is not available: libcode64 was built without zlib.\n");
+            else if (ferror(fout_using))
+               fprintf(stderr, "Failed to write the output (%s).\n", strerror(errno));
+            else if (operation == Encode)
+               fprintf(stderr, "Failed to compress the input.\n");
+            else
+               fprintf(stderr, "Failed to decompress: the decoded data is not gzip or zlib data, or is incomplete.\n");
+            close_FILEs(fin, fout);
+            return 1;
+         }
+      }
+      else if (use_mmap && (operation == Encode || operation == Decode))
+      {
+         // The payload is large by the user's say, whatever its size:
+         if (use_large)
+            c64_set_large_threshold(1);
+
+         if (convert_mapped(fin_using, fout_using, selected_radix->radix, operation == Decode,
+                            breaks, use_large, use_crc ? &crc : NULL))
+         {
+            fprintf(stderr, "Failed to %s the input (%s).\n",
+                    operation == Decode ? "decode" : "encode", strerror(errno));
+            close_FILEs(fin, fout);
+            return 1;
+         }
+      }
+      // The single-threaded functions below take over if the threads fail to start:
+      else if (threads >= 0 && operation == Encode
+               && 0 == c64_encode_stream_to_stream_pipelined(selected_radix->radix, fin_using, fout_using,
+                                                             breaks, threads, use_crc ? &crc : NULL))
+         ;
+      else if (threads >= 0 && operation == Decode
+               && 0 == c64_decode_stream_to_stream_pipelined(selected_radix->radix, fin_using, fout_using,
+                                                             threads, use_crc ? &crc : NULL))
+         ;
+      else if (threads >= 0 && (ferror(fin_using) || ferror(fout_using)))
+      {
+         // The pipeline failed while converting, so the streams are spent:
+         fprintf(stderr, "Failed to %s the input (%s error).\n",
+                 operation == Decode ? "decode" : "encode", ferror(fin_using) ? "read" : "write");
+         close_FILEs(fin, fout);
+         return 1;
+      }
+      else if (selected_radix->radix != C64_BASE64 && operation == Encode)
+         c64_radix_encode_stream_to_stream(selected_radix->radix, fin_using, fout_using,
+                                           breaks, use_crc ? &crc : NULL);
+      else if (selected_radix->radix != C64_BASE64 && operation == Decode)
+         c64_radix_decode_stream_to_stream(selected_radix->radix, fin_using, fout_using,
+                                           use_crc ? &crc : NULL);
+      else if (operation == Encode)
+         c64_encode_stream_to_stream_crc(fin_using, fout_using, breaks, use_crc ? &crc : NULL);
       else if (operation == Decode)
-         c64_decode_stream_to_stream(fin_using, fout_using);
+         c64_decode_stream_to_stream_crc(fin_using, fout_using, use_crc ? &crc : NULL);
+      else if (operation == Extract)
+      {
+         Extract_Target target = { out_filename ? out_filename : "block-", 0, NULL, "", 0, 0 };
+         unsigned int blocks = c64_extract_blocks(fin_using, write_extracted_block, &target);
+
+         fprintf(stderr, "Extracted %u block%s.\n", blocks, blocks == 1 ? "" : "s");
+         if (target.failed)
+         {
+            close_FILEs(fin, fout);
+            return 1;
+         }
+      }
+      else if (operation == Transcode
+               && c64_transcode_stream_to_stream(fin_using, fout_using,
+                                                 from_stype->specials, to_stype->specials,
+                                                 breaks))
+      {
+         fprintf(stderr, "Failed to transcode the input (%s error).\n", ferror(fin_using) ? "read" : "write");
+         close_FILEs(fin, fout);
+         return 1;
+      }
 
       close_FILEs(fin, fout);
+
+      if (expected_crc)
+      {
+         if (crc != (uint32_t)strtoul(expected_crc, NULL, 16))
+         {
+            fprintf(stderr, "CRC32C mismatch: expected %s, computed %08x.\n", expected_crc, crc);
+            return 1;
+         }
+      }
+      else if (use_crc)
+         fprintf(stderr, "CRC32C: %08x\n", crc);
    }
 
    return 0;
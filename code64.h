@@ -3,34 +3,181 @@
 
 #include <stdint.h>    // for uint34_t definition
 #include <stdio.h>     // for FILE*
-#include <sys/types.h> // for size_t
+#include <sys/types.h> // for size_t, off_t
+
+/**
+ * Single-header mode: define C64_HEADER_ONLY before including this
+ * header to compile the entire codec into the including translation
+ * unit as static inline functions.  The program then needs neither
+ * libcode64.so nor libcode64.a, and the compiler is free to inline
+ * the sizing and per-group functions into the caller's loops.
+ *
+ * libcode64.c must be in the include path in that case.
+ */
+#ifdef C64_HEADER_ONLY
+#define C64_API static inline
+#else
+#define C64_API
+#endif
+
+/** Encodings supported by the c64_radix_* functions. */
+typedef enum _C64_Radix
+{
+   C64_BASE64,
+   C64_BASE32,
+   C64_BASE32HEX,
+   C64_BASE16
+} C64_Radix;
+
+/**
+ * Reader and writer of the *_reader_to_writer functions, for input and
+ * output other than FILE streams.  A read function returns the number
+ * of bytes it put in *buffer*, up to *len*, 0 at the end of the input,
+ * or -1 on error.  A write function returns *len* if it took all of the
+ * data.  *context* is the caller's, passed to every call.
+ */
+typedef ssize_t (*C64_Read)(void *context, void *buffer, size_t len);
+typedef ssize_t (*C64_Write)(void *context, const void *data, size_t len);
+
+typedef struct _C64_Reader
+{
+   C64_Read read;
+   void *context;
+} C64_Reader;
+
+typedef struct _C64_Writer
+{
+   C64_Write write;
+   void *context;
+} C64_Writer;
+
+/** Buffer read by c64_memory_reader() or written by c64_memory_writer(). */
+typedef struct _C64_Memory
+{
+   char *data;
+   size_t size;         // bytes to read, or room to write
+   size_t position;     // bytes read or written so far
+   int growable;        // writer may enlarge *data* with realloc
+} C64_Memory;
 
 typedef void (*Encode_User)(const char *encoded_content);
 typedef void (*Decode_User)(const void *decoded_content, size_t data_length);
 
+/** Events reported to the Block_User callback of c64_extract_blocks(). */
+typedef enum _C64_Block_Event
+{
+   C64_BLOCK_BEGIN,
+   C64_BLOCK_DATA,
+   C64_BLOCK_END
+} C64_Block_Event;
+
+typedef void (*Block_User)(void *user_data, C64_Block_Event event, const char *label,
+                           const void *data, size_t data_length);
+
 /** Replace special encoding characters '+', '/', and '=' with alternates. */
-void c64_set_special_chars(const char *special_chars);
+C64_API void c64_set_special_chars(const char *special_chars);
 
 /** Returns length of right-trimmed input string. */
-size_t c64_decoding_length(const char *input);
+C64_API size_t c64_decoding_length(const char *input);
 
 /** Functions to predict memory requirements of encoding and decoding. */
-size_t c64_encode_chars_needed(size_t input_size);
-size_t c64_decode_chars_needed(size_t input_size);
+C64_API size_t c64_encode_chars_needed(size_t input_size);
+C64_API size_t c64_decode_chars_needed(size_t input_size);
+C64_API size_t c64_encode_uint32s_needed(size_t input_size);
+C64_API size_t c64_decode_uint32s_needed(size_t input_size);
 
-size_t c64_encode_required_buffer_length(size_t input_size) { return c64_encode_chars_needed(input_size); }
+static inline size_t c64_encode_required_buffer_length(size_t input_size) { return c64_encode_chars_needed(input_size); }
 
 /** Functions to perform conversions of the smallest portion the input. */
-const char *c64_encode_to_pointer(const char *input, int count, uint32_t *buff_var);
-int c64_decode_to_pointer(const char *input, uint32_t *buff_var);
+C64_API const char *c64_encode_to_pointer(const char *input, int count, uint32_t *buff_var);
+C64_API int c64_decode_to_pointer(const char *input, uint32_t *buff_var);
 
 /** Encoding functions that convert the entire input **/
-void c64_encode_to_buffer(const char *input, size_t len_input, uint32_t *buffer, int bufflen);
-void c64_encode_stream_to_stream(FILE *in, FILE *out, unsigned int breaks);
+C64_API void c64_encode_to_buffer(const char *input, size_t len_input, uint32_t *buffer, int bufflen);
+C64_API void c64_encode_stream_to_stream(FILE *in, FILE *out, unsigned int breaks);
 
 /** Decoding functions that convert the entire input **/
-void c64_decode_to_buffer(const char *input, char *buffer, size_t len);
-void c64_decode_stream_to_stream(FILE *in, FILE *out);
+C64_API void c64_decode_to_buffer(const char *input, char *buffer, size_t len);
+C64_API void c64_decode_stream_to_stream(FILE *in, FILE *out);
+
+/** CRC32C checksum, and stream functions that compute it of the unencoded data **/
+C64_API uint32_t c64_crc32c(uint32_t crc, const void *data, size_t len);
+C64_API void c64_encode_stream_to_stream_crc(FILE *in, FILE *out, unsigned int breaks, uint32_t *crc);
+C64_API void c64_decode_stream_to_stream_crc(FILE *in, FILE *out, uint32_t *crc);
+
+/** Translate encoded text between sets of special characters without decoding **/
+C64_API size_t c64_transcode_chars_needed(size_t input_size, unsigned int breaks);
+C64_API size_t c64_transcode_to_buffer(const char *input, size_t len, char *buffer, size_t bufflen,
+                                       const char *from_specials, const char *to_specials,
+                                       unsigned int breaks);
+C64_API int c64_transcode_stream_to_stream(FILE *in, FILE *out,
+                                            const char *from_specials, const char *to_specials,
+                                            unsigned int breaks);
 
+/** Base16, base32 and base32hex (and base64) through the shared conversion engine **/
+C64_API size_t c64_radix_encode_chars_needed(C64_Radix radix, size_t input_size);
+C64_API size_t c64_radix_decode_chars_needed(C64_Radix radix, size_t input_size);
+C64_API size_t c64_radix_encode_to_buffer(C64_Radix radix, const void *input, size_t len,
+                                          char *buffer, size_t bufflen);
+C64_API size_t c64_radix_decode_to_buffer(C64_Radix radix, const char *input, size_t len,
+                                          void *buffer, size_t bufflen);
+C64_API void c64_radix_encode_stream_to_stream(C64_Radix radix, FILE *in, FILE *out,
+                                               unsigned int breaks, uint32_t *crc);
+C64_API void c64_radix_decode_stream_to_stream(C64_Radix radix, FILE *in, FILE *out, uint32_t *crc);
+
+/** Find and decode the base64 blocks of PEM bundles and MIME messages **/
+C64_API unsigned int c64_extract_blocks(FILE *in, Block_User callback, void *user_data);
+
+/** Decode part of the original data without decoding what precedes it **/
+C64_API int c64_decode_range(FILE *in, FILE *out, off_t first, off_t last);
+C64_API off_t c64_build_index(FILE *in, FILE *index, unsigned int interval);
+C64_API int c64_decode_range_indexed(FILE *in, FILE *index, FILE *out, off_t first, off_t last);
+
+/** Stream conversion with reading, converting and writing in concurrent threads **/
+C64_API int c64_encode_stream_to_stream_pipelined(C64_Radix radix, FILE *in, FILE *out,
+                                                  unsigned int breaks, unsigned int threads,
+                                                  uint32_t *crc);
+C64_API int c64_decode_stream_to_stream_pipelined(C64_Radix radix, FILE *in, FILE *out,
+                                                  unsigned int threads, uint32_t *crc);
+
+/** Validate encoded input and find the exact length of its decoding, without decoding it **/
+C64_API int c64_radix_check_buffer(C64_Radix radix, const char *input, size_t len,
+                                   size_t *decoded_length, size_t *error_offset);
+C64_API int c64_radix_check_stream(C64_Radix radix, FILE *in,
+                                   uint64_t *decoded_length, uint64_t *error_offset);
+
+/** Stream conversion fused with gzip compression before encoding or decompression after decoding **/
+C64_API int c64_encode_stream_to_stream_deflate(C64_Radix radix, FILE *in, FILE *out,
+                                                unsigned int breaks, int level, uint32_t *crc);
+C64_API int c64_decode_stream_to_stream_inflate(C64_Radix radix, FILE *in, FILE *out, uint32_t *crc);
+
+/** Stream conversion through reader and writer callbacks, and the built-in adapters **/
+C64_API int c64_radix_encode_reader_to_writer(C64_Radix radix, C64_Reader in, C64_Writer out,
+                                              unsigned int breaks, uint32_t *crc);
+C64_API int c64_radix_decode_reader_to_writer(C64_Radix radix, C64_Reader in, C64_Writer out, uint32_t *crc);
+C64_API C64_Reader c64_file_reader(FILE *file);
+C64_API C64_Writer c64_file_writer(FILE *file);
+C64_API C64_Reader c64_fd_reader(int fd);
+C64_API C64_Writer c64_fd_writer(int fd);
+C64_API C64_Reader c64_memory_reader(C64_Memory *memory);
+C64_API C64_Writer c64_memory_writer(C64_Memory *memory);
+
+/** Large payloads: bypass the cache when writing, and huge-page buffers **/
+C64_API void c64_set_large_threshold(size_t bytes);
+C64_API void *c64_alloc_large(size_t size);
+C64_API void c64_free_large(void *buffer, size_t size);
+
+/** Decode base64 whose special characters are detected from the input, among candidate sets **/
+C64_API int c64_detect_special_chars(const char *input, size_t len,
+                                     const char *const *candidates, unsigned int count);
+C64_API size_t c64_decode_detected_to_buffer(const char *input, size_t len, void *buffer, size_t bufflen,
+                                             const char *const *candidates, unsigned int count, int *detected);
+C64_API int c64_decode_detected_reader_to_writer(C64_Reader in, C64_Writer out,
+                                                 const char *const *candidates, unsigned int count,
+                                                 int *detected, uint32_t *crc);
+
+#ifdef C64_HEADER_ONLY
+#include "libcode64.c"
+#endif
 
 #endif
@@ -5,6 +5,7 @@
 #include <errno.h>    // make available the global errno variable
 #include <alloca.h>
 #include <stdlib.h>   // for malloc()
+#include <unistd.h>   // for access(), to find the code64 command
 
 #include "code64.h"
 
@@ -300,6 +301,824 @@ void encode_to_buffer_test(const char *str)
    free(buffer);
 }
 
+/**
+ * @brief Confirm the CRC32C against the standard check value, and that
+ *        the encode and decode stream functions agree on the checksum.
+ */
+void test_crc32c(void)
+{
+   printf("\n[33;1mBeginning test_crc32c.[m\n");
+
+   uint32_t check = c64_crc32c(0, "123456789", 9);
+   printf("CRC32C of \"123456789\" is %08x, %s.\n",
+          check, check == 0xe3069283 ? "correct" : "[41mINCORRECT[m");
+
+   uint32_t direct = c64_crc32c(0, buff_quote, strlen(buff_quote));
+   uint32_t encoded_crc = 0, decoded_crc = 0;
+
+   FILE *raw = tmpfile();
+   FILE *encoded = tmpfile();
+   FILE *decoded = tmpfile();
+
+   fputs(buff_quote, raw);
+   rewind(raw);
+
+   c64_encode_stream_to_stream_crc(raw, encoded, 76, &encoded_crc);
+   rewind(encoded);
+   c64_decode_stream_to_stream_crc(encoded, decoded, &decoded_crc);
+
+   if (direct == encoded_crc && direct == decoded_crc)
+      printf("The stream checksums match (%08x).\n", direct);
+   else
+      printf("The stream checksums DO NOT match: %08x, %08x, %08x.\n",
+             direct, encoded_crc, decoded_crc);
+
+   fclose(raw);
+   fclose(encoded);
+   fclose(decoded);
+}
+
+/**
+ * @brief Translate the encoded leviathan quote to base64url and back.
+ */
+void test_transcode(void)
+{
+   printf("\n[33;1mBeginning test_transcode.[m\n");
+
+   size_t len = strlen(buff_encoded);
+   size_t bufflen = c64_transcode_chars_needed(len, 0);
+   char *urlsafe = (char*)malloc(bufflen);
+   char *restored = (char*)malloc(bufflen);
+
+   c64_transcode_to_buffer(buff_encoded, len, urlsafe, bufflen, "+/=", "-_", 0);
+   printf("[32;1m%s[m\n", urlsafe);
+
+   c64_transcode_to_buffer(urlsafe, strlen(urlsafe), restored, bufflen, "-_", "+/=", 0);
+
+   if (strcmp(restored, buff_encoded))
+      printf("The round trip results DO NOT match.\n");
+   else
+      printf("The round trip results match.\n");
+
+   FILE *in = fmemopen((char*)buff_encoded, len, "r");
+   FILE *out = tmpfile();
+   printf("Transcoding a stream succeeds, %s.\n",
+          c64_transcode_stream_to_stream(in, out, "+/=", "-_", 0) == 0 ? "correct" : "[41mINCORRECT[m");
+
+   FILE *full = fopen("/dev/full", "w");
+   if (full)
+   {
+      rewind(in);
+      printf("Transcoding to a full device fails, %s.\n",
+             c64_transcode_stream_to_stream(in, full, "+/=", "-_", 0) == -1 ? "correct" : "[41mINCORRECT[m");
+      fclose(full);
+   }
+   fclose(in);
+   fclose(out);
+
+   free(urlsafe);
+   free(restored);
+}
+
+/**
+ * @brief Check the base16, base32 and base32hex test vectors of RFC 4648,
+ *        then round-trip the leviathan quote through each encoding.
+ */
+void test_radix(void)
+{
+   struct vector { C64_Radix radix; const char *name; const char *encoded; };
+   const struct vector vectors[] = {
+      { C64_BASE16,    "base16",    "666F6F626172" },
+      { C64_BASE32,    "base32",    "MZXW6YTBOI======" },
+      { C64_BASE32HEX, "base32hex", "CPNMUOJ1E8======" },
+      { C64_BASE64,    "base64",    "Zm9vYmFy" }
+   };
+
+   char encoded[1024];
+   char decoded[1024];
+   size_t len_quote = strlen(buff_quote);
+
+   printf("\n[33;1mBeginning test_radix.[m\n");
+
+   for (unsigned int i=0; i < sizeof(vectors) / sizeof(vectors[0]); ++i)
+   {
+      const struct vector *v = &vectors[i];
+
+      c64_radix_encode_to_buffer(v->radix, "foobar", 6, encoded, sizeof(encoded));
+      printf("%-9s foobar -> [32;1m%s[m, %s.\n", v->name, encoded,
+             strcmp(encoded, v->encoded) ? "[41mINCORRECT[m" : "correct");
+
+      size_t len_encoded = c64_radix_encode_to_buffer(v->radix, buff_quote, len_quote,
+                                                      encoded, sizeof(encoded));
+      size_t len_decoded = c64_radix_decode_to_buffer(v->radix, encoded, len_encoded,
+                                                      decoded, sizeof(decoded));
+
+      if (len_decoded == len_quote && !memcmp(decoded, buff_quote, len_quote))
+         printf("%-9s round trip of the quote matches.\n", v->name);
+      else
+         printf("%-9s round trip of the quote DOES NOT match.\n", v->name);
+   }
+}
+
+/**
+ * @brief Block_User callback that prints the blocks found by c64_extract_blocks().
+ */
+void show_extracted_block(void *user_data, C64_Block_Event event, const char *label,
+                          const void *data, size_t data_length)
+{
+   if (event == C64_BLOCK_BEGIN)
+      printf("Block [32;1m%s[m: ", label);
+   else if (event == C64_BLOCK_DATA)
+      printf("[44;1m%.*s[m", (int)data_length, (const char*)data);
+   else
+      printf("\n");
+}
+
+void test_extract_blocks(void)
+{
+   char document[] =
+      "Some text before the blocks.\n"
+      "-----BEGIN QUOTE-----\n"
+      "YW55IGNhcm5hbCBwbGVh\n"
+      "c3VyZS4=\n"
+      "-----END QUOTE-----\n"
+      "--boundary\n"
+      "Content-Type: text/plain; name=\"pleasure.txt\"\n"
+      "Content-Transfer-Encoding: base64\n"
+      "\n"
+      "YW55IGNhcm5hbCBwbGVhc3Vy\n"
+      "--boundary--\n";
+
+   printf("\n[33;1mBeginning test_extract_blocks.[m\n");
+
+   FILE *in = fmemopen(document, strlen(document), "r");
+   unsigned int blocks = c64_extract_blocks(in, show_extracted_block, NULL);
+   fclose(in);
+
+   printf("Found %u blocks, %s.\n", blocks, blocks == 2 ? "correct" : "[41mINCORRECT[m");
+}
+
+/**
+ * @brief Decode a slice of the encoded leviathan quote, directly from
+ *        its fixed-width lines and through an index.
+ */
+void test_decode_range(void)
+{
+   char slice[64];
+   size_t len_slice;
+   int result;
+
+   printf("\n[33;1mBeginning test_decode_range.[m\n");
+
+   FILE *raw = tmpfile();
+   FILE *encoded = tmpfile();
+   FILE *index = tmpfile();
+   FILE *out = tmpfile();
+
+   fputs(buff_quote, raw);
+   rewind(raw);
+   c64_encode_stream_to_stream(raw, encoded, 16);
+
+   for (int indexed=0; indexed < 2; ++indexed)
+   {
+      rewind(out);
+      if (indexed)
+      {
+         c64_build_index(encoded, index, 30);
+         result = c64_decode_range_indexed(encoded, index, out, 100, 131);
+      }
+      else
+         result = c64_decode_range(encoded, out, 100, 131);
+
+      len_slice = ftell(out);
+      rewind(out);
+      len_slice = fread(slice, 1, len_slice, out);
+
+      printf("%s range [100, 131) is [44;1m%.*s[m, %s.\n",
+             indexed ? "Indexed" : "Fixed-width",
+             (int)len_slice, slice,
+             (!result && len_slice == 31 && !memcmp(slice, buff_quote + 100, 31)) ? "correct" : "[41mINCORRECT[m");
+   }
+
+   FILE *full = fopen("/dev/full", "w");
+   if (full)
+   {
+      printf("Decoding a range to a full device fails, %s.\n",
+             c64_decode_range(encoded, full, 100, 131) == -1 ? "correct" : "[41mINCORRECT[m");
+      clearerr(full);
+      printf("Indexing to a full device fails, %s.\n",
+             c64_build_index(encoded, full, 30) == -1 ? "correct" : "[41mINCORRECT[m");
+      fclose(full);
+   }
+
+   fclose(raw);
+   fclose(encoded);
+   fclose(index);
+   fclose(out);
+}
+
+/**
+ * @brief Returns 1 if the contents of two files are the same.
+ */
+int same_contents(FILE *first, FILE *second)
+{
+   int a, b;
+
+   rewind(first);
+   rewind(second);
+   do
+   {
+      a = fgetc(first);
+      b = fgetc(second);
+   } while (a == b && a != EOF);
+
+   return a == b;
+}
+
+void test_pipelined(void)
+{
+   // More than a few chunks, so that every thread gets more than one:
+   size_t len = 3 * 1024 * 1024 + 17;
+   uint32_t crc_in = 0, crc_out = 0;
+   int result;
+
+   printf("\n[33;1mBeginning test_pipelined.[m\n");
+
+   FILE *raw = tmpfile();
+   FILE *serial = tmpfile();
+   FILE *pipelined = tmpfile();
+   FILE *decoded = tmpfile();
+
+   srand(64);
+   for (size_t i = 0; i < len; ++i)
+      fputc(rand() & 0xFF, raw);
+
+   rewind(raw);
+   c64_encode_stream_to_stream(raw, serial, 76);
+   rewind(raw);
+   result = c64_encode_stream_to_stream_pipelined(C64_BASE64, raw, pipelined, 76, 3, &crc_in);
+
+   printf("Pipelined encoding %s serial encoding.\n",
+          (!result && same_contents(serial, pipelined)) ? "matches" : "[41mDOES NOT match[m");
+
+   rewind(pipelined);
+   result = c64_decode_stream_to_stream_pipelined(C64_BASE64, pipelined, decoded, 2, &crc_out);
+
+   printf("Pipelined decoding %s the original.\n",
+          (!result && same_contents(raw, decoded)) ? "matches" : "[41mDOES NOT match[m");
+   printf("CRC32C of input and output are %08x and %08x, %s.\n", crc_in, crc_out,
+          crc_in == crc_out ? "correct" : "[41mINCORRECT[m");
+
+   // Writing to a full device fails, and so does reading a directory:
+   FILE *full = fopen("/dev/full", "w");
+   if (full)
+   {
+      rewind(raw);
+      printf("Pipelined encoding to a full device fails, %s.\n",
+             c64_encode_stream_to_stream_pipelined(C64_BASE64, raw, full, 76, 3, NULL) == -1
+             && ferror(full) ? "correct" : "[41mINCORRECT[m");
+      fclose(full);
+   }
+
+   FILE *directory = fopen(".", "r");
+   if (directory)
+   {
+      rewind(decoded);
+      printf("Pipelined decoding of an unreadable stream fails, %s.\n",
+             c64_decode_stream_to_stream_pipelined(C64_BASE64, directory, decoded, 2, NULL) == -1
+             && ferror(directory) ? "correct" : "[41mINCORRECT[m");
+      fclose(directory);
+   }
+
+   fclose(raw);
+   fclose(serial);
+   fclose(pipelined);
+   fclose(decoded);
+}
+
+void test_fixed_lines(void)
+{
+   size_t len = strlen(buff_quote);
+   size_t len_encoded = c64_radix_encode_chars_needed(C64_BASE64, len);
+   char *encoded = (char*)malloc(len_encoded);
+   char *lines = (char*)malloc(len_encoded * 2);
+   char *decoded = (char*)malloc(len_encoded * 2);
+   char *ptr = lines;
+
+   printf("\n[33;1mBeginning test_fixed_lines.[m\n");
+
+   len_encoded = c64_radix_encode_to_buffer(C64_BASE64, buff_quote, len, encoded, len_encoded);
+
+   // 16-character lines, but with a stray space in the fourth line
+   // and the seventh line broken early:
+   for (size_t i = 0, line = 0; i < len_encoded; i += 16, ++line)
+   {
+      size_t count = len_encoded - i < 16 ? len_encoded - i : 16;
+      if (line == 3)
+      {
+         memcpy(ptr, encoded + i, 5);
+         ptr[5] = ' ';
+         memcpy(ptr + 6, encoded + i + 5, count - 5);
+         ptr += count + 1;
+      }
+      else if (line == 6)
+      {
+         memcpy(ptr, encoded + i, 8);
+         memcpy(ptr + 8, "\r\n", 2);
+         memcpy(ptr + 10, encoded + i + 8, count - 8);
+         ptr += count + 2;
+      }
+      else
+      {
+         memcpy(ptr, encoded + i, count);
+         ptr += count;
+      }
+      memcpy(ptr, "\r\n", 2);
+      ptr += 2;
+   }
+
+   size_t len_decoded = c64_radix_decode_to_buffer(C64_BASE64, lines, ptr - lines, decoded,
+                                                   c64_radix_decode_chars_needed(C64_BASE64, ptr - lines));
+
+   printf("Decoding irregular 16-character lines is %s.\n",
+          (len_decoded == len && !memcmp(decoded, buff_quote, len)) ? "correct" : "[41mINCORRECT[m");
+
+   free(encoded);
+   free(lines);
+   free(decoded);
+}
+
+void test_check(void)
+{
+   static const struct
+   {
+      C64_Radix radix;
+      const char *input;
+      int valid;
+      size_t length_or_offset;
+   } cases[] = {
+      { C64_BASE64, "Zm9vYmFy",           1, 6 },
+      { C64_BASE64, "Zm9v Yg==\t",        1, 4 },
+      { C64_BASE64, "Zm9vYg",             1, 4 },
+      { C64_BASE64, "Zm9vYg=",            0, 7 },
+      { C64_BASE64, "Zm9vY",              0, 5 },
+      { C64_BASE64, "Zm9vYg==Zm9v",       0, 8 },
+      { C64_BASE64, "Zm9v.Yg==",          0, 4 },
+      { C64_BASE32, "MZXW6YTBOI======",   1, 6 },
+      { C64_BASE32, "MZXW6YTBO",          0, 9 },
+      { C64_BASE16, "666f6F",             1, 3 }
+   };
+
+   printf("\n[33;1mBeginning test_check.[m\n");
+
+   for (unsigned int i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i)
+   {
+      size_t length = 0, offset = 0;
+      int valid = c64_radix_check_buffer(cases[i].radix, cases[i].input, strlen(cases[i].input),
+                                         &length, &offset);
+
+      printf("%-20s %s %zu, %s.\n", cases[i].input,
+             valid ? "is valid, decoding to" : "is invalid at offset",
+             valid ? length : offset,
+             (valid == cases[i].valid && (valid ? length : offset) == cases[i].length_or_offset)
+             ? "correct" : "[41mINCORRECT[m");
+   }
+
+   // The stream version, over more than one block:
+   size_t len = strlen(buff_quote) * 100;
+   uint64_t length = 0, offset = 0;
+   FILE *raw = tmpfile();
+   FILE *encoded = tmpfile();
+
+   for (int i = 0; i < 100; ++i)
+      fputs(buff_quote, raw);
+   rewind(raw);
+   c64_encode_stream_to_stream(raw, encoded, 76);
+   rewind(encoded);
+
+   int valid = c64_radix_check_stream(C64_BASE64, encoded, &length, &offset);
+   printf("Encoded stream of %zu bytes checks as %s of %llu bytes, %s.\n", len,
+          valid ? "valid" : "invalid", (unsigned long long)length,
+          (valid && length == len) ? "correct" : "[41mINCORRECT[m");
+
+   fclose(raw);
+   fclose(encoded);
+}
+
+void test_deflate(void)
+{
+   uint32_t crc_in = 0, crc_out = 0;
+   int encoded_result, decoded_result;
+
+   printf("\n[33;1mBeginning test_deflate.[m\n");
+
+   FILE *raw = tmpfile();
+   FILE *encoded = tmpfile();
+   FILE *decoded = tmpfile();
+
+   for (int i = 0; i < 1000; ++i)
+      fputs(buff_quote, raw);
+   rewind(raw);
+
+   encoded_result = c64_encode_stream_to_stream_deflate(C64_BASE64, raw, encoded, 76, -1, &crc_in);
+   long len_raw = ftell(raw);
+   long len_encoded = ftell(encoded);
+   rewind(encoded);
+   decoded_result = c64_decode_stream_to_stream_inflate(C64_BASE64, encoded, decoded, &crc_out);
+
+   printf("%ld bytes compressed and encoded to %ld characters.\n", len_raw, len_encoded);
+   printf("Decoding and decompressing %s the original.\n",
+          (!encoded_result && !decoded_result && same_contents(raw, decoded)) ? "matches" : "[41mDOES NOT match[m");
+   printf("CRC32C of input and output are %08x and %08x, %s.\n", crc_in, crc_out,
+          crc_in == crc_out ? "correct" : "[41mINCORRECT[m");
+
+   // Encoded data that is not compressed must fail:
+   rewind(raw);
+   rewind(encoded);
+   c64_encode_stream_to_stream(raw, encoded, 76);
+   rewind(encoded);
+   printf("Inflating uncompressed data fails, %s.\n",
+          c64_decode_stream_to_stream_inflate(C64_BASE64, encoded, decoded, NULL) == -1 ? "correct" : "[41mINCORRECT[m");
+
+   // Output that cannot be written must fail, whether it fills the
+   // stdio buffer or only fails when flushed at the end:
+   FILE *full = fopen("/dev/full", "w");
+   if (full)
+   {
+      FILE *compressed = tmpfile();
+
+      rewind(raw);
+      printf("Deflating to a full device fails, %s.\n",
+             c64_encode_stream_to_stream_deflate(C64_BASE64, raw, full, 76, -1, NULL) == -1
+             ? "correct" : "[41mINCORRECT[m");
+
+      rewind(raw);
+      c64_encode_stream_to_stream_deflate(C64_BASE64, raw, compressed, 76, -1, NULL);
+      rewind(compressed);
+      clearerr(full);
+      printf("Inflating to a full device fails, %s.\n",
+             c64_decode_stream_to_stream_inflate(C64_BASE64, compressed, full, NULL) == -1
+             ? "correct" : "[41mINCORRECT[m");
+
+      fclose(compressed);
+      fclose(full);
+   }
+
+   fclose(raw);
+   fclose(encoded);
+   fclose(decoded);
+}
+
+void test_reader_writer(void)
+{
+   size_t len = strlen(buff_quote);
+   size_t needed = c64_radix_encode_chars_needed(C64_BASE32, len);
+   char *expected = (char*)malloc(needed);
+   char decoded[1024];
+   int result;
+
+   printf("\n[33;1mBeginning test_reader_writer.[m\n");
+
+   c64_radix_encode_to_buffer(C64_BASE32, buff_quote, len, expected, needed);
+
+   // Memory to a growable memory buffer:
+   C64_Memory source = { (char*)buff_quote, len, 0, 0 };
+   C64_Memory encoded = { NULL, 0, 0, 1 };
+   result = c64_radix_encode_reader_to_writer(C64_BASE32, c64_memory_reader(&source),
+                                              c64_memory_writer(&encoded), 0, NULL);
+   printf("Encoding memory to a growable buffer %s the buffer function.\n",
+          (!result && encoded.position == strlen(expected)
+           && !memcmp(encoded.data, expected, encoded.position)) ? "matches" : "[41mDOES NOT match[m");
+
+   // And back, to a fixed buffer:
+   C64_Memory encoded_source = { encoded.data, encoded.position, 0, 0 };
+   C64_Memory restored = { decoded, sizeof(decoded), 0, 0 };
+   result = c64_radix_decode_reader_to_writer(C64_BASE32, c64_memory_reader(&encoded_source),
+                                              c64_memory_writer(&restored), NULL);
+   printf("Decoding it to a fixed buffer %s the original.\n",
+          (!result && restored.position == len && !memcmp(decoded, buff_quote, len))
+          ? "matches" : "[41mDOES NOT match[m");
+
+   // A fixed buffer that is too small fails:
+   encoded_source.position = 0;
+   restored.size = len / 2;
+   restored.position = 0;
+   printf("Decoding to a buffer that is too small fails, %s.\n",
+          c64_radix_decode_reader_to_writer(C64_BASE32, c64_memory_reader(&encoded_source),
+                                            c64_memory_writer(&restored), NULL) == -1
+          ? "correct" : "[41mINCORRECT[m");
+
+   // A FILE reader to a file descriptor writer, against the stream function:
+   FILE *raw = tmpfile();
+   FILE *by_stream = tmpfile();
+   FILE *by_fd = tmpfile();
+
+   for (int i = 0; i < 200; ++i)
+      fputs(buff_quote, raw);
+
+   rewind(raw);
+   c64_radix_encode_stream_to_stream(C64_BASE64, raw, by_stream, 76, NULL);
+   rewind(raw);
+   result = c64_radix_encode_reader_to_writer(C64_BASE64, c64_file_reader(raw),
+                                              c64_fd_writer(fileno(by_fd)), 76, NULL);
+   printf("Encoding a FILE to a file descriptor %s the stream function.\n",
+          (!result && same_contents(by_stream, by_fd)) ? "matches" : "[41mDOES NOT match[m");
+
+   fclose(raw);
+   fclose(by_stream);
+   fclose(by_fd);
+   free(encoded.data);
+   free(expected);
+}
+
+/**
+ * @brief Encode a bit at a time, as a reference for the conversion
+ *        functions, which take several bytes at a time.
+ */
+size_t reference_encode(const char *alphabet, unsigned int bits, const unsigned char *in, size_t len, char *out)
+{
+   unsigned int group_chars = bits == 5 ? 8 : (bits == 6 ? 4 : 2);
+   size_t chars = 0;
+
+   for (size_t bit = 0; bit < len * 8; bit += bits)
+   {
+      unsigned int value = 0;
+      for (unsigned int i = 0; i < bits; ++i)
+      {
+         size_t at = bit + i;
+         int set = at < len * 8 && (in[at / 8] >> (7 - at % 8)) & 1;
+         value = (value << 1) | set;
+      }
+      out[chars++] = alphabet[value];
+   }
+
+   while (bits != 4 && chars % group_chars)
+      out[chars++] = '=';
+
+   out[chars] = '\0';
+   return chars;
+}
+
+void test_short_lengths(void)
+{
+   struct codec { C64_Radix radix; const char *name; unsigned int bits; const char *alphabet; };
+   const struct codec codecs[] = {
+      { C64_BASE16,    "base16",    4, "0123456789ABCDEF" },
+      { C64_BASE32,    "base32",    5, "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567" },
+      { C64_BASE32HEX, "base32hex", 5, "0123456789ABCDEFGHIJKLMNOPQRSTUV" },
+      { C64_BASE64,    "base64",    6, "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/" }
+   };
+
+   const unsigned char *quote = (const unsigned char*)buff_quote;
+   char encoded[256], expected[256];
+   char decoded[128];
+
+   printf("\n[33;1mBeginning test_short_lengths.[m\n");
+
+   // Every length through 48 bytes, which covers the short-input
+   // paths and the remainders of the SIMD functions:
+   for (unsigned int c = 0; c < sizeof(codecs) / sizeof(codecs[0]); ++c)
+   {
+      const struct codec *codec = &codecs[c];
+      unsigned int failures = 0;
+
+      for (size_t len = 0; len <= 48; ++len)
+      {
+         reference_encode(codec->alphabet, codec->bits, quote + len, len, expected);
+         size_t len_encoded = c64_radix_encode_to_buffer(codec->radix, quote + len, len, encoded, sizeof(encoded));
+         size_t len_decoded = c64_radix_decode_to_buffer(codec->radix, encoded, len_encoded,
+                                                         decoded, sizeof(decoded));
+
+         if (strcmp(encoded, expected) || len_decoded != len || memcmp(decoded, quote + len, len))
+            ++failures;
+      }
+
+      printf("%-9s lengths 0 to 48 encode and decode, %s.\n", codec->name,
+             failures ? "[41mINCORRECT[m" : "correct");
+   }
+
+   // The group-at-a-time functions:
+   unsigned int failures = 0;
+   for (size_t start = 0; start < 64; ++start)
+   {
+      uint32_t group, working;
+      reference_encode(codecs[3].alphabet, 6, quote + start, 3, expected);
+      c64_encode_to_pointer((const char*)quote + start, 3, &group);
+      if (memcmp(&group, expected, 4))
+         ++failures;
+
+      c64_decode_to_pointer(expected, &working);
+      if (memcmp(&working, quote + start, 3))
+         ++failures;
+   }
+
+   printf("c64_encode_to_pointer and c64_decode_to_pointer, %s.\n",
+          failures ? "[41mINCORRECT[m" : "correct");
+}
+
+void test_large(void)
+{
+   const size_t len = 100000;
+   unsigned char *raw = (unsigned char*)c64_alloc_large(len);
+   size_t needed = c64_radix_encode_chars_needed(C64_BASE64, len);
+   char *expected = (char*)malloc(needed);
+   char *encoded = (char*)c64_alloc_large(needed);
+   size_t room = c64_radix_decode_chars_needed(C64_BASE64, needed);
+   unsigned char *decoded = (unsigned char*)c64_alloc_large(room);
+   size_t len_expected, len_encoded, len_decoded;
+
+   printf("\n[33;1mBeginning test_large.[m\n");
+
+   if (!raw || !encoded || !decoded)
+   {
+      printf("Allocating large buffers [41mFAILED[m.\n");
+      return;
+   }
+
+   for (size_t i = 0; i < len; ++i)
+      raw[i] = (unsigned char)(i * 7 + i / 251);
+
+   len_expected = c64_radix_encode_to_buffer(C64_BASE64, raw, len, expected, needed);
+
+   // Everything is large from here on:
+   c64_set_large_threshold(1);
+
+   len_encoded = c64_radix_encode_to_buffer(C64_BASE64, raw, len, encoded, needed);
+   printf("Large-mode encoding %s the cached encoding.\n",
+          (len_encoded == len_expected && !memcmp(encoded, expected, len_encoded))
+          ? "matches" : "[41mDOES NOT match[m");
+
+   len_decoded = c64_radix_decode_to_buffer(C64_BASE64, encoded, len_encoded, decoded, room);
+   printf("Large-mode decoding %s the original.\n",
+          (len_decoded == len && !memcmp(decoded, raw, len)) ? "matches" : "[41mDOES NOT match[m");
+
+   // MIME lines, through the memory reader and writer:
+   C64_Memory source = { (char*)raw, len, 0, 0 };
+   C64_Memory lined = { NULL, 0, 0, 1 };
+   c64_radix_encode_reader_to_writer(C64_BASE64, c64_memory_reader(&source),
+                                     c64_memory_writer(&lined), 76, NULL);
+
+   C64_Memory lined_source = { lined.data, lined.position, 0, 0 };
+   C64_Memory restored = { (char*)decoded, len, 0, 0 };
+   memset(decoded, 0, len);
+   int result = c64_radix_decode_reader_to_writer(C64_BASE64, c64_memory_reader(&lined_source),
+                                                  c64_memory_writer(&restored), NULL);
+   printf("Large-mode decoding of MIME lines to memory %s the original.\n",
+          (!result && restored.position == len && !memcmp(decoded, raw, len))
+          ? "matches" : "[41mDOES NOT match[m");
+
+   c64_set_large_threshold(0);
+
+   free(lined.data);
+   free(expected);
+   c64_free_large(raw, len);
+   c64_free_large(encoded, needed);
+   c64_free_large(decoded, room);
+}
+
+/** @return 1 if the files named *first* and *second* hold the same bytes. */
+int same_files(const char *first, const char *second)
+{
+   FILE *a = fopen(first, "r");
+   FILE *b = fopen(second, "r");
+   int same = a && b && same_contents(a, b);
+
+   if (a)
+      fclose(a);
+   if (b)
+      fclose(b);
+   return same;
+}
+
+/**
+ * code64 --large maps a regular output file only when it can, and
+ * otherwise writes it, as when stdout is redirected to a file opened
+ * for writing only.  Either way, the output must be the normal output.
+ */
+void test_large_cli(void)
+{
+   const char *raw_name = "/tmp/codetest-large.bin";
+   const char *commands[] = {
+      "./code64 -i /tmp/codetest-large.bin -o /tmp/codetest-large.b64",
+      "./code64 --large -i /tmp/codetest-large.bin > /tmp/codetest-large-stdout.b64",
+      "./code64 --large -i /tmp/codetest-large.bin -o /tmp/codetest-large-mapped.b64",
+      "./code64 -d --large -i /tmp/codetest-large.b64 > /tmp/codetest-large-stdout.bin"
+   };
+   int failed = 0;
+
+   printf("\n[33;1mBeginning test_large_cli.[m\n");
+
+   if (access("./code64", X_OK) != 0)
+   {
+      printf("Skipped: run codetest where code64 is built.\n");
+      return;
+   }
+
+   FILE *raw = fopen(raw_name, "w");
+   for (int i = 0; i < 102637; ++i)
+      fputc((i * 7 + i / 253) & 0xFF, raw);
+   fclose(raw);
+
+   for (unsigned int c = 0; c < sizeof(commands) / sizeof(commands[0]); ++c)
+      if (system(commands[c]) != 0)
+         ++failed;
+
+   printf("Encoding with --large to a redirected stdout %s the normal output.\n",
+          (!failed && same_files("/tmp/codetest-large.b64", "/tmp/codetest-large-stdout.b64"))
+          ? "matches" : "[41mDOES NOT match[m");
+   printf("Encoding with --large to a mapped -o file %s the normal output.\n",
+          (!failed && same_files("/tmp/codetest-large.b64", "/tmp/codetest-large-mapped.b64"))
+          ? "matches" : "[41mDOES NOT match[m");
+   printf("Decoding with --large to a redirected stdout %s the original.\n",
+          (!failed && same_files(raw_name, "/tmp/codetest-large-stdout.bin"))
+          ? "matches" : "[41mDOES NOT match[m");
+
+   remove(raw_name);
+   remove("/tmp/codetest-large.b64");
+   remove("/tmp/codetest-large-stdout.b64");
+   remove("/tmp/codetest-large-mapped.b64");
+   remove("/tmp/codetest-large-stdout.bin");
+}
+
+/**
+ * Replace the special characters of standard base64 in *encoded* with
+ * those of *specials*, dropping the padding if it has none.
+ */
+void respecial(char *encoded, const char *specials)
+{
+   char *out = encoded;
+
+   for (const char *in = encoded; *in; ++in)
+   {
+      if (*in == '+')
+         *out++ = specials[0];
+      else if (*in == '/')
+         *out++ = specials[1];
+      else if (*in == '=')
+      {
+         if (specials[2])
+            *out++ = specials[2];
+      }
+      else
+         *out++ = *in;
+   }
+   *out = '\0';
+}
+
+void test_detect(void)
+{
+   const char *standards[] = { "+/=", "-_", "+,", "._-", "~-=" };
+   const unsigned int count = sizeof(standards) / sizeof(standards[0]);
+   unsigned char raw[1000];
+   size_t needed = c64_radix_encode_chars_needed(C64_BASE64, sizeof(raw));
+   char *encoded = (char*)malloc(needed);
+   unsigned char decoded[1024];
+   int detected;
+
+   printf("\n[33;1mBeginning test_detect.[m\n");
+
+   for (size_t i = 0; i < sizeof(raw); ++i)
+      raw[i] = (unsigned char)(i * 13 + i / 7);
+
+   // Each standard's encoding, found among all of them and decoded:
+   unsigned int failures = 0;
+   for (unsigned int s = 0; s < count; ++s)
+   {
+      c64_radix_encode_to_buffer(C64_BASE64, raw, sizeof(raw) - 1, encoded, needed);
+      respecial(encoded, standards[s]);
+
+      size_t len = c64_decode_detected_to_buffer(encoded, strlen(encoded), decoded, sizeof(decoded),
+                                                 standards, count, &detected);
+      if (detected != (int)s || len != sizeof(raw) - 1 || memcmp(decoded, raw, len))
+         ++failures;
+   }
+   printf("Detecting and decoding %u standards, %s.\n", count, failures ? "[41mINCORRECT[m" : "correct");
+
+   // The default candidates, through a memory reader and writer:
+   c64_radix_encode_to_buffer(C64_BASE64, raw, sizeof(raw), encoded, needed);
+   respecial(encoded, "-_");
+
+   C64_Memory source = { encoded, strlen(encoded), 0, 0 };
+   C64_Memory restored = { (char*)decoded, sizeof(decoded), 0, 0 };
+   int result = c64_decode_detected_reader_to_writer(c64_memory_reader(&source), c64_memory_writer(&restored),
+                                                     NULL, 0, &detected, NULL);
+   printf("Detecting base64url in a stream %s the original.\n",
+          (!result && detected == 1 && restored.position == sizeof(raw) && !memcmp(decoded, raw, sizeof(raw)))
+          ? "matches" : "[41mDOES NOT match[m");
+
+   // Without special characters, the first candidate:
+   printf("Input without special characters detects the first candidate, %s.\n",
+          c64_detect_special_chars("aGVsbG8gd29ybGQ", 15, standards + 1, count - 1) == 0
+          ? "correct" : "[41mINCORRECT[m");
+
+   // Detection leaves the special characters of c64_set_special_chars alone:
+   c64_radix_encode_to_buffer(C64_BASE64, (const unsigned char*)"\xfb\xff", 2, encoded, needed);
+   printf("Encoding after detection still uses \"+/=\", %s.\n",
+          strcmp(encoded, "+/8=") ? "[41mINCORRECT[m" : "correct");
+
+   free(encoded);
+}
+
 void run_tests(void)
 {
    prediction_test();
@@ -311,7 +1130,20 @@ void run_tests(void)
    test_decoding();
    decode_to_callback("YW55IGNhcm5hbCBwbGVhc3Vy", show_decoded_string);
    test_allowing_invalid_encode_chars();
-
+   test_crc32c();
+   test_transcode();
+   test_radix();
+   test_extract_blocks();
+   test_decode_range();
+   test_pipelined();
+   test_fixed_lines();
+   test_check();
+   test_deflate();
+   test_reader_writer();
+   test_short_lengths();
+   test_large();
+   test_large_cli();
+   test_detect();
 }
 
 int main(int argc, const char **argv)
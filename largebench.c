@@ -0,0 +1,260 @@
+// -*- compile-command: "cc -Wall -Werror -O2 -pthread -I. -L. -o largebench largebench.c -Wl,-R -Wl,. -lcode64" -*-
+
+/**
+ * largebench: show what encoding and decoding a large payload does to
+ * another thread that depends on the cache.
+ *
+ * A victim thread walks a random cycle of pointers through a working
+ * set that fits in the last-level cache, and counts the nanoseconds
+ * each step takes, as a latency-sensitive service would see its
+ * lookups slow down.  The main thread encodes and decodes a payload
+ * far larger than the cache, first writing through the cache and then
+ * with the non-temporal stores of the large-payload mode.  The victim's
+ * time is its own CPU time, so the comparison also holds on a host
+ * with fewer processors than threads.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <sched.h>      // sched_yield()
+
+#include "code64.h"
+
+typedef struct _Victim
+{
+   uint64_t *nodes;          // one pointer per cache line
+   size_t count;
+   atomic_int running;
+   atomic_int measuring;
+   atomic_int done;          // set once steps and cpu_seconds are written
+   uint64_t steps;
+   double cpu_seconds;
+} Victim;
+
+void show_usage(void)
+{
+   printf("largebench [-p payload_mb] [-w working_set_kb] [-r rounds]\n");
+   printf("-p payload_mb     Size of the data encoded and decoded (default 256).\n");
+   printf("-w working_set_kb Size of the victim's pointer cycle (default 16384).\n");
+   printf("-r rounds         Encodings and decodings of the payload per mode (default 3).\n");
+}
+
+double thread_seconds(void)
+{
+   struct timespec now;
+   clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+   return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+double wall_seconds(void)
+{
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief Link the nodes in one random cycle, so that every step of the
+ *        walk is a dependent load the hardware prefetchers cannot guess.
+ *
+ * @return 0 on success, -1 if memory ran out.
+ */
+int make_cycle(Victim *victim)
+{
+   size_t *order = (size_t*)malloc(victim->count * sizeof(size_t));
+   const size_t stride = 64 / sizeof(uint64_t);
+
+   if (!order)
+      return -1;
+
+   for (size_t i = 0; i < victim->count; ++i)
+      order[i] = i;
+
+   for (size_t i = victim->count - 1; i > 0; --i)
+   {
+      size_t j = ((size_t)rand() * RAND_MAX + rand()) % (i + 1);
+      size_t t = order[i];
+      order[i] = order[j];
+      order[j] = t;
+   }
+
+   for (size_t i = 0; i < victim->count; ++i)
+      victim->nodes[order[i] * stride] = order[(i + 1) % victim->count] * stride;
+
+   free(order);
+   return 0;
+}
+
+void *victim_walk(void *arg)
+{
+   Victim *victim = (Victim*)arg;
+   uint64_t at = 0, steps = 0;
+   double started = 0;
+   int measuring = 0;
+
+   while (atomic_load(&victim->running))
+   {
+      for (int i = 0; i < 4096; ++i)
+         at = victim->nodes[at];
+      steps += 4096;
+
+      // Start or stop counting when the main thread says so:
+      if (measuring != atomic_load(&victim->measuring))
+      {
+         measuring = !measuring;
+         if (measuring)
+         {
+            steps = 0;
+            started = thread_seconds();
+         }
+         else
+         {
+            victim->steps = steps;
+            victim->cpu_seconds = thread_seconds() - started;
+            atomic_store(&victim->done, 1);
+         }
+      }
+   }
+
+   // Keep the walk from being optimized away:
+   if (at == (uint64_t)-1)
+      printf("\n");
+   return NULL;
+}
+
+/**
+ * @brief Encode and decode the payload *rounds* times while the victim's
+ *        steps are counted, and report both sides.
+ */
+void run_mode(const char *name, Victim *victim, size_t threshold, int rounds,
+              const unsigned char *payload, size_t len, char *encoded, size_t len_encoded,
+              unsigned char *decoded, size_t len_decoded)
+{
+   double converted = 0;
+   size_t chars = 0;
+
+   c64_set_large_threshold(threshold);
+
+   atomic_store(&victim->measuring, 1);
+   double started = wall_seconds();
+
+   for (int round = 0; round < rounds; ++round)
+   {
+      if (payload)
+      {
+         chars = c64_radix_encode_to_buffer(C64_BASE64, payload, len, encoded, len_encoded);
+         c64_radix_decode_to_buffer(C64_BASE64, encoded, chars, decoded, len_decoded);
+         converted += len + chars;
+      }
+      else
+      {
+         // No payload: let the victim run alone for a while.
+         struct timespec pause = { 0, 300 * 1000 * 1000 };
+         nanosleep(&pause, NULL);
+      }
+   }
+
+   double elapsed = wall_seconds() - started;
+   atomic_store(&victim->measuring, 0);
+   while (!atomic_load(&victim->done))
+      sched_yield();
+
+   if (payload && memcmp(payload, decoded, len))
+      printf("The decoded payload DOES NOT match.\n");
+
+   if (payload)
+      printf("%-10s %10.0f %16.1f\n", name, converted / elapsed / 1e6,
+             victim->cpu_seconds * 1e9 / victim->steps);
+   else
+      printf("%-10s %10s %16.1f\n", name, "-", victim->cpu_seconds * 1e9 / victim->steps);
+
+   atomic_store(&victim->done, 0);
+}
+
+int main(int argc, char **argv)
+{
+   size_t payload_mb = 256, working_kb = 16384;
+   int rounds = 3;
+
+   for (int arg = 1; arg < argc; ++arg)
+   {
+      if (argv[arg][0] != '-' || arg + 1 == argc)
+      {
+         show_usage();
+         return 1;
+      }
+
+      switch (argv[arg][1])
+      {
+         case 'p':
+            payload_mb = strtoul(argv[++arg], NULL, 10);
+            break;
+         case 'w':
+            working_kb = strtoul(argv[++arg], NULL, 10);
+            break;
+         case 'r':
+            rounds = atoi(argv[++arg]);
+            break;
+         default:
+            show_usage();
+            return 1;
+      }
+   }
+
+   size_t len = payload_mb * 1024 * 1024;
+   size_t len_encoded = c64_radix_encode_chars_needed(C64_BASE64, len);
+   size_t len_decoded = c64_radix_decode_chars_needed(C64_BASE64, len_encoded);
+
+   unsigned char *payload = (unsigned char*)c64_alloc_large(len);
+   char *encoded = (char*)c64_alloc_large(len_encoded);
+   unsigned char *decoded = (unsigned char*)c64_alloc_large(len_decoded);
+
+   Victim victim;
+   memset(&victim, 0, sizeof(victim));
+   victim.count = working_kb * 1024 / 64;
+   victim.nodes = (uint64_t*)c64_alloc_large(victim.count * 64);
+
+   if (!payload || !encoded || !decoded || !victim.nodes || victim.count < 2)
+   {
+      fprintf(stderr, "Failed to allocate the payload and working set.\n");
+      return 1;
+   }
+
+   for (size_t i = 0; i < len; ++i)
+      payload[i] = rand();
+
+   if (make_cycle(&victim))
+   {
+      fprintf(stderr, "Failed to allocate the order of the working set.\n");
+      return 1;
+   }
+   atomic_store(&victim.running, 1);
+
+   pthread_t thread;
+   if (pthread_create(&thread, NULL, victim_walk, &victim))
+   {
+      fprintf(stderr, "Failed to start the victim thread.\n");
+      return 1;
+   }
+
+   printf("Payload %zu MB, victim working set %zu KB, %d rounds.\n", payload_mb, working_kb, rounds);
+   printf("%-10s %10s %16s\n", "mode", "codec MB/s", "victim ns/step");
+
+   run_mode("alone", &victim, 0, rounds, NULL, 0, NULL, 0, NULL, 0);
+   run_mode("cached", &victim, SIZE_MAX, rounds, payload, len, encoded, len_encoded, decoded, len_decoded);
+   run_mode("streaming", &victim, 1, rounds, payload, len, encoded, len_encoded, decoded, len_decoded);
+
+   atomic_store(&victim.running, 0);
+   pthread_join(thread, NULL);
+
+   c64_free_large(payload, len);
+   c64_free_large(encoded, len_encoded);
+   c64_free_large(decoded, len_decoded);
+   c64_free_large(victim.nodes, victim.count * 64);
+   return 0;
+}
@@ -1,25 +1,692 @@
 #include <stdio.h>    // for fprintf to report errors
 #include <string.h>   // for strlen
 #include <stdint.h>   // for uint64_t, etc.
+#include <stdlib.h>   // for malloc, free
+#include <strings.h>  // for strncasecmp
 #include <assert.h>
 
 #include <ctype.h>    // for isspace
+#include <errno.h>    // for EINTR
+
+#include <pthread.h>     // for the threads of pipelined streams
+#include <stdatomic.h>   // for the queues between them
+#include <sched.h>       // for sched_yield
+#include <time.h>        // for nanosleep
+#include <unistd.h>      // for sysconf
+#include <sys/mman.h>    // for the huge-page buffers of large payloads
+
+#ifndef C64_NO_ZLIB
+#include <zlib.h>        // for the deflate and inflate stages
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define C64_X86 1
+#include <nmmintrin.h> // for SSE4.2 _mm_crc32_* intrinsics
+#include <emmintrin.h> // for SSE2, always available on x86-64
+#include <tmmintrin.h> // for SSSE3 _mm_shuffle_epi8, selected at runtime
+#include <immintrin.h> // for BMI2 _pdep_u64 and _pext_u64, selected at runtime
+#include <cpuid.h>     // for __get_cpuid, to avoid slow BMI2 implementations
+#endif
 
 #include "code64.h"
 
-char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+/**
+ * USDT probes for bpftrace, perf and SystemTap, under the provider name
+ * "code64".  With <sys/sdt.h>, a probe is a single nop plus a note in
+ * the ELF file that a tracer finds and patches when it attaches, so
+ * probes cost nothing in production until they are used.  Without the
+ * header, or when built with C64_NO_SDT, they compile to nothing.
+ */
+#if !defined(C64_NO_SDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define C64_SDT 1
+#endif
+#endif
+
+#ifdef C64_SDT
+#define C64_PROBE1(name, a)       STAP_PROBE1(code64, name, a)
+#define C64_PROBE2(name, a, b)    STAP_PROBE2(code64, name, a, b)
+#define C64_PROBE3(name, a, b, c) STAP_PROBE3(code64, name, a, b, c)
+#else
+#define C64_PROBE1(name, a)       ((void)0)
+#define C64_PROBE2(name, a, b)    ((void)0)
+#define C64_PROBE3(name, a, b, c) ((void)0)
+#endif
+
+/**
+ * Internal functions and variables are private to this file.  In
+ * single-header mode (see code64.h), they are compiled into the
+ * including file as static inline along with the public functions.
+ */
+#ifdef C64_HEADER_ONLY
+#define C64_LOCAL static inline
+#else
+#define C64_LOCAL static
+#endif
+
+static char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static char digit62 = '+';
+static char digit63 = '/';
+static char padding_char = '=';
+
+/** Values in a codec's decode table for characters that are not digits. */
+#define C64_PADDING 0x40
+#define C64_INVALID 0xFF
+
+/** Size of the input blocks read by the stream functions, a multiple of 3 and 5. */
+#define C64_BLOCK_SIZE (15 * 1024)
+
+/** Partial group of digits carried between decoded blocks. */
+typedef struct _C64_Decode_State
+{
+   uint64_t bits;
+   int count;
+} C64_Decode_State;
+
+typedef struct _C64_Codec C64_Codec;
+
+/**
+ * Bulk conversion functions convert a run of complete groups, stopping
+ * at the end of the input or, when decoding, at the first group that
+ * contains a character that is not a digit.  They return the number of
+ * input bytes or characters consumed, always a multiple of the group size.
+ */
+typedef size_t (*C64_Bulk_Encode)(const C64_Codec *codec, const unsigned char *in, size_t len, char *out);
+typedef size_t (*C64_Bulk_Decode)(const C64_Codec *codec, const unsigned char *in, size_t len, unsigned char *out);
+
+/**
+ * @brief Description of a radix encoding for the shared conversion engine.
+ *
+ * Every *group_bytes* bytes are encoded as *group_chars* digits of *bits*
+ * bits each.  The engine handles line breaks, skipped characters, padding
+ * and incomplete groups for every encoding, leaving only runs of complete
+ * groups to the bulk functions of each codec.  **prepare_codec** replaces
+ * the bulk functions with SIMD versions if the CPU supports them.
+ */
+struct _C64_Codec
+{
+   unsigned int bits;
+   unsigned int group_bytes;
+   unsigned int group_chars;
+   const char *alphabet;
+   char padding;                // '\0' to omit padding
+   C64_Bulk_Encode bulk_encode;
+   C64_Bulk_Decode bulk_decode;
+   char ranges[3][3];           // first, last, value offset of digit ranges for SIMD decoding
+   unsigned char table[256];    // digit values, C64_PADDING or C64_INVALID
+   atomic_int ready;            // set, with release order, once table and functions are built
+   C64_Bulk_Encode tail_encode; // non-SIMD functions, for short input
+   C64_Bulk_Decode tail_decode; // and the remainders of the SIMD functions
+};
+
+/**
+ * @brief Bulk encode complete 3-byte groups to base64.
+ *
+ * Each triad is converted without the per-byte shifting of
+ * **c64_encode_to_pointer**.
+ */
+C64_LOCAL size_t base64_bulk_encode(const C64_Codec *codec, const unsigned char *in, size_t len, char *out)
+{
+   const char *alphabet = codec->alphabet;
+   const unsigned char *ptr = in;
+   const unsigned char *end = in + len - len % 3;
+   uint32_t working;
+
+   while (ptr < end)
+   {
+      working = (ptr[0] << 16) | (ptr[1] << 8) | ptr[2];
+      out[0] = alphabet[working >> 18];
+      out[1] = alphabet[(working >> 12) & 0x3F];
+      out[2] = alphabet[(working >> 6) & 0x3F];
+      out[3] = alphabet[working & 0x3F];
+
+      ptr += 3;
+      out += 4;
+   }
+
+   return ptr - in;
+}
+
+/**
+ * @brief Bulk decode complete 4-character groups of base64 digits.
+ *
+ * Uses one table lookup per character, checking all four for padding
+ * or invalid characters at once.
+ */
+C64_LOCAL size_t base64_bulk_decode(const C64_Codec *codec, const unsigned char *in, size_t len, unsigned char *out)
+{
+   const unsigned char *table = codec->table;
+   const unsigned char *ptr = in;
+   const unsigned char *end = in + len;
+
+   while (end - ptr >= 4)
+   {
+      unsigned int a = table[ptr[0]];
+      unsigned int b = table[ptr[1]];
+      unsigned int c = table[ptr[2]];
+      unsigned int d = table[ptr[3]];
+
+      // Any padding or invalid character sets a high bit:
+      if ((a | b | c | d) & 0xC0)
+         break;
+
+      uint32_t working = (a << 18) | (b << 12) | (c << 6) | d;
+      out[0] = working >> 16;
+      out[1] = working >> 8;
+      out[2] = working;
+
+      ptr += 4;
+      out += 3;
+   }
+
+   return ptr - in;
+}
+
+/**
+ * @brief Bulk encode complete groups of any radix, a bit at a time.
+ */
+C64_LOCAL size_t radix_bulk_encode(const C64_Codec *codec, const unsigned char *in, size_t len, char *out)
+{
+   const char *alphabet = codec->alphabet;
+   unsigned int mask = (1 << codec->bits) - 1;
+   size_t groups = len / codec->group_bytes;
+   uint64_t working;
+
+   for (size_t group=0; group < groups; ++group)
+   {
+      working = 0;
+      for (unsigned int i=0; i < codec->group_bytes; ++i)
+         working = (working << 8) | *in++;
+
+      for (int shift = codec->group_chars * codec->bits; shift > 0; )
+      {
+         shift -= codec->bits;
+         *out++ = alphabet[(working >> shift) & mask];
+      }
+   }
+
+   return groups * codec->group_bytes;
+}
+
+/**
+ * @brief Bulk decode complete groups of any radix.
+ */
+C64_LOCAL size_t radix_bulk_decode(const C64_Codec *codec, const unsigned char *in, size_t len, unsigned char *out)
+{
+   const unsigned char *table = codec->table;
+   const unsigned char *ptr = in;
+   uint64_t working;
+   unsigned int val, check;
+
+   while (in + len - ptr >= codec->group_chars)
+   {
+      working = 0;
+      check = 0;
+      for (unsigned int i=0; i < codec->group_chars; ++i)
+      {
+         val = table[ptr[i]];
+         check |= val;
+         working = (working << codec->bits) | val;
+      }
+
+      if (check & 0xC0)
+         break;
+
+      for (unsigned int i = codec->group_bytes; i-- > 0; )
+      {
+         out[i] = working;
+         working >>= 8;
+      }
+
+      ptr += codec->group_chars;
+      out += codec->group_bytes;
+   }
+
+   return ptr - in;
+}
+
+#ifdef C64_X86
+/** Digit values in the low *bits* bits of each byte of a 64-bit word. */
+#define C64_LANES(bits) (0x0101010101010101ULL * ((1u << (bits)) - 1))
+
+/**
+ * @brief Returns 1 if the CPU has BMI2 and its pdep and pext are fast.
+ *
+ * AMD processors before Zen 3 (family 19h) implement pdep and pext in
+ * microcode at hundreds of cycles each, far slower than shifting.
+ */
+C64_LOCAL int fast_bmi2(void)
+{
+   unsigned int eax, ebx, ecx, edx;
+
+   if (!__builtin_cpu_supports("bmi2"))
+      return 0;
+
+   if (__get_cpuid(0, &eax, &ebx, &ecx, &edx) && ebx == 0x68747541)   // "Auth"enticAMD
+   {
+      __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+      unsigned int family = (eax >> 8) & 0xF;
+      if (family == 0xF)
+         family += (eax >> 20) & 0xFF;
+      return family >= 0x19;
+   }
+
+   return 1;
+}
+
+/**
+ * @brief Encode 8 digits at a time of any radix with pdep.
+ *
+ * Eight digits hold exactly *bits* bytes: 6 for base64, 5 for base32
+ * and 4 for base16.  The bytes are loaded as a big-endian number and
+ * pdep spreads it into one digit value per byte, last digit first.
+ * The characters are assembled in one word and stored at once.  8 bytes
+ * are loaded to use *bits* of them, so the last few bytes, and any
+ * complete groups among them, go to the plain function.  Inlined with
+ * a constant *bits* for each radix.
+ */
+static inline __attribute__((target("bmi2"), always_inline))
+size_t bmi2_encode_digits(const C64_Codec *codec, const unsigned char *in, size_t len, char *out,
+                          const unsigned int bits)
+{
+   const char *alphabet = codec->alphabet;
+   size_t done = 0;
+   uint64_t word;
+
+   while (len - done >= 8)
+   {
+      memcpy(&word, in + done, 8);
+      word = _pdep_u64(__builtin_bswap64(word) >> (64 - bits * 8), C64_LANES(bits));
+
+      // The last digit is in the low byte:
+      out[0] = alphabet[word >> 56];
+      out[1] = alphabet[(word >> 48) & 0xFF];
+      out[2] = alphabet[(word >> 40) & 0xFF];
+      out[3] = alphabet[(word >> 32) & 0xFF];
+      out[4] = alphabet[(word >> 24) & 0xFF];
+      out[5] = alphabet[(word >> 16) & 0xFF];
+      out[6] = alphabet[(word >> 8) & 0xFF];
+      out[7] = alphabet[word & 0xFF];
+
+      done += bits;
+      out += 8;
+   }
+
+   C64_Bulk_Encode plain = bits == 6 ? base64_bulk_encode : radix_bulk_encode;
+   return done + plain(codec, in + done, len - done, out);
+}
+
+/**
+ * @brief Decode 8 digits at a time of any radix with pext.
+ *
+ * The reverse of **bmi2_encode_digits**: the 8 digit values are
+ * gathered in one word, first digit in the high byte, and pext packs
+ * them into a number of *bits* bytes.  The 8-byte store writes past
+ * the decoded bytes, so it is only used while at least 16 characters
+ * remain, leaving room in any buffer sized for the input.
+ */
+static inline __attribute__((target("bmi2"), always_inline))
+size_t bmi2_decode_digits(const C64_Codec *codec, const unsigned char *in, size_t len, unsigned char *out,
+                          const unsigned int bits)
+{
+   const unsigned char *table = codec->table;
+   size_t done = 0;
+   uint64_t word;
+
+   while (len - done >= 16)
+   {
+      const unsigned char *packed = in + done;
+      word = (uint64_t)table[packed[0]] << 56 | (uint64_t)table[packed[1]] << 48
+         | (uint64_t)table[packed[2]] << 40 | (uint64_t)table[packed[3]] << 32
+         | (uint64_t)table[packed[4]] << 24 | (uint64_t)table[packed[5]] << 16
+         | (uint64_t)table[packed[6]] << 8 | table[packed[7]];
+
+      // Any padding or invalid character sets a high bit:
+      if (word & 0xC0C0C0C0C0C0C0C0ULL)
+         break;
+
+      word = __builtin_bswap64(_pext_u64(word, C64_LANES(bits)) << (64 - bits * 8));
+      memcpy(out, &word, 8);
+
+      done += 8;
+      out += bits;
+   }
+
+   C64_Bulk_Decode plain = bits == 6 ? base64_bulk_decode : radix_bulk_decode;
+   return done + plain(codec, in + done, len - done, out);
+}
+
+/**
+ * @brief Encode one base64 triad to 4 digits with pdep, for
+ *        **c64_encode_to_pointer**.
+ */
+C64_LOCAL __attribute__((target("bmi2")))
+void bmi2_encode_triad(const C64_Codec *codec, const unsigned char *in, char *out)
+{
+   uint32_t word = _pdep_u32((in[0] << 16) | (in[1] << 8) | in[2], 0x3F3F3F3F);
+
+   out[0] = codec->alphabet[word >> 24];
+   out[1] = codec->alphabet[(word >> 16) & 0xFF];
+   out[2] = codec->alphabet[(word >> 8) & 0xFF];
+   out[3] = codec->alphabet[word & 0xFF];
+}
+
+/**
+ * @brief Decode 4 base64 digits to 3 bytes with pext, for
+ *        **c64_decode_to_pointer**.
+ *
+ * @return 1, or 0 if the string ends early or has padding or another
+ *         character that is not a digit.
+ */
+C64_LOCAL __attribute__((target("bmi2")))
+int bmi2_decode_quad(const C64_Codec *codec, const unsigned char *in, unsigned char *out)
+{
+   const unsigned char *table = codec->table;
+
+   // In order, so as not to read past the end of the string:
+   if (!in[0] || !in[1] || !in[2] || !in[3])
+      return 0;
+
+   uint32_t word = table[in[0]] << 24 | table[in[1]] << 16 | table[in[2]] << 8 | table[in[3]];
+   if (word & 0xC0C0C0C0)
+      return 0;
+
+   word = _pext_u32(word, 0x3F3F3F3F);
+   out[0] = word >> 16;
+   out[1] = word >> 8;
+   out[2] = word;
+   return 1;
+}
+
+C64_LOCAL __attribute__((target("bmi2")))
+size_t bmi2_bulk_encode(const C64_Codec *codec, const unsigned char *in, size_t len, char *out)
+{
+   switch (codec->bits)
+   {
+      case 6:
+         return bmi2_encode_digits(codec, in, len, out, 6);
+      case 5:
+         return bmi2_encode_digits(codec, in, len, out, 5);
+      default:
+         return bmi2_encode_digits(codec, in, len, out, 4);
+   }
+}
+
+C64_LOCAL __attribute__((target("bmi2")))
+size_t bmi2_bulk_decode(const C64_Codec *codec, const unsigned char *in, size_t len, unsigned char *out)
+{
+   switch (codec->bits)
+   {
+      case 6:
+         return bmi2_decode_digits(codec, in, len, out, 6);
+      case 5:
+         return bmi2_decode_digits(codec, in, len, out, 5);
+      default:
+         return bmi2_decode_digits(codec, in, len, out, 4);
+   }
+}
+
+/**
+ * @brief Translate 16 characters to digit values using the codec's
+ *        ranges of digits.
+ *
+ * @return 1 if all 16 characters are digits, otherwise 0.
+ */
+C64_LOCAL __attribute__((target("ssse3")))
+int simd_decode_digits(const C64_Codec *codec, __m128i chars, __m128i *values)
+{
+   __m128i result = _mm_setzero_si128();
+   __m128i matched = _mm_setzero_si128();
+
+   for (int i=0; i < 3; ++i)
+   {
+      const char *range = codec->ranges[i];
+      __m128i in_range = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8(range[0] - 1)),
+                                       _mm_cmplt_epi8(chars, _mm_set1_epi8(range[1] + 1)));
+      result = _mm_or_si128(result, _mm_and_si128(in_range, _mm_add_epi8(chars, _mm_set1_epi8(range[2]))));
+      matched = _mm_or_si128(matched, in_range);
+   }
+
+   *values = result;
+   return _mm_movemask_epi8(matched) == 0xFFFF;
+}
+
+/**
+ * @brief Base16 encode 16 bytes at a time, using the alphabet as a
+ *        pshufb lookup table for the high and low nibbles.
+ */
+C64_LOCAL __attribute__((target("ssse3")))
+size_t base16_bulk_encode_ssse3(const C64_Codec *codec, const unsigned char *in, size_t len, char *out)
+{
+   __m128i lookup = _mm_loadu_si128((const __m128i*)codec->alphabet);
+   __m128i nibble = _mm_set1_epi8(0x0F);
+   size_t done = 0;
+
+   while (len - done >= 16)
+   {
+      __m128i bytes = _mm_loadu_si128((const __m128i*)(in + done));
+      __m128i high = _mm_shuffle_epi8(lookup, _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble));
+      __m128i low = _mm_shuffle_epi8(lookup, _mm_and_si128(bytes, nibble));
+
+      _mm_storeu_si128((__m128i*)(out + done * 2), _mm_unpacklo_epi8(high, low));
+      _mm_storeu_si128((__m128i*)(out + done * 2 + 16), _mm_unpackhi_epi8(high, low));
+      done += 16;
+   }
+
+   return done + codec->tail_encode(codec, in + done, len - done, out + done * 2);
+}
+
+/**
+ * @brief Base16 decode 32 characters at a time, combining nibble
+ *        pairs with pmaddubsw.
+ */
+C64_LOCAL __attribute__((target("ssse3")))
+size_t base16_bulk_decode_ssse3(const C64_Codec *codec, const unsigned char *in, size_t len, unsigned char *out)
+{
+   __m128i weights = _mm_set1_epi16(0x0110);  // high nibble * 16 + low nibble
+   __m128i first, second;
+   size_t done = 0;
+
+   while (len - done >= 32)
+   {
+      if (!simd_decode_digits(codec, _mm_loadu_si128((const __m128i*)(in + done)), &first)
+          || !simd_decode_digits(codec, _mm_loadu_si128((const __m128i*)(in + done + 16)), &second))
+         break;
+
+      first = _mm_maddubs_epi16(first, weights);
+      second = _mm_maddubs_epi16(second, weights);
+      _mm_storeu_si128((__m128i*)(out + done / 2), _mm_packus_epi16(first, second));
+      done += 32;
+   }
+
+   return done + codec->tail_decode(codec, in + done, len - done, out + done / 2);
+}
+
+/**
+ * @brief Base32 encode 10 bytes at a time.
+ *
+ * The bytes are shuffled into two big-endian 40-bit values, which are
+ * split in halves three times (to 20, 10, then 5 bits) to leave one
+ * digit value per byte, in order.  Reads 16 bytes to use 10.
+ */
+C64_LOCAL __attribute__((target("ssse3")))
+size_t base32_bulk_encode_ssse3(const C64_Codec *codec, const unsigned char *in, size_t len, char *out)
+{
+   __m128i spread = _mm_setr_epi8(4, 3, 2, 1, 0, -1, -1, -1, 9, 8, 7, 6, 5, -1, -1, -1);
+   __m128i lookup_low = _mm_loadu_si128((const __m128i*)codec->alphabet);
+   __m128i lookup_high = _mm_loadu_si128((const __m128i*)(codec->alphabet + 16));
+   size_t done = 0;
+
+   while (len - done >= 16)
+   {
+      __m128i x = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in + done)), spread);
+
+      x = _mm_or_si128(_mm_srli_epi64(x, 20),
+                       _mm_slli_epi64(_mm_and_si128(x, _mm_set1_epi64x(0xFFFFF)), 32));
+      x = _mm_or_si128(_mm_srli_epi32(x, 10),
+                       _mm_slli_epi32(_mm_and_si128(x, _mm_set1_epi32(0x3FF)), 16));
+      x = _mm_or_si128(_mm_srli_epi16(x, 5),
+                       _mm_slli_epi16(_mm_and_si128(x, _mm_set1_epi16(0x1F)), 8));
+
+      __m128i high = _mm_cmpgt_epi8(x, _mm_set1_epi8(15));
+      __m128i chars = _mm_or_si128(_mm_andnot_si128(high, _mm_shuffle_epi8(lookup_low, x)),
+                                   _mm_and_si128(high, _mm_shuffle_epi8(lookup_high, x)));
+
+      _mm_storeu_si128((__m128i*)(out + done / 5 * 8), chars);
+      done += 10;
+   }
+
+   return done + codec->tail_encode(codec, in + done, len - done, out + done / 5 * 8);
+}
+
+/**
+ * @brief Base32 decode 16 characters at a time.
+ *
+ * The reverse of **base32_bulk_encode_ssse3**, digit values are merged
+ * in pairs (to 10, 20, then 40 bits) and the two 40-bit values are
+ * shuffled out as 10 big-endian bytes.  The 16-byte store writes 6
+ * bytes past the decoded data, so it is only used while at least 32
+ * characters remain, leaving room in any buffer sized for the input.
+ */
+C64_LOCAL __attribute__((target("ssse3")))
+size_t base32_bulk_decode_ssse3(const C64_Codec *codec, const unsigned char *in, size_t len, unsigned char *out)
+{
+   __m128i gather = _mm_setr_epi8(4, 3, 2, 1, 0, 12, 11, 10, 9, 8, -1, -1, -1, -1, -1, -1);
+   __m128i x;
+   size_t done = 0;
+
+   while (len - done >= 32)
+   {
+      if (!simd_decode_digits(codec, _mm_loadu_si128((const __m128i*)(in + done)), &x))
+         break;
+
+      x = _mm_maddubs_epi16(x, _mm_set1_epi16(0x0120));   // first * 32 + second
+      x = _mm_madd_epi16(x, _mm_set1_epi32(0x00010400));  // first * 1024 + second
+      x = _mm_or_si128(_mm_slli_epi64(_mm_and_si128(x, _mm_set1_epi64x(0xFFFFFFFF)), 20),
+                       _mm_srli_epi64(x, 32));
+
+      _mm_storeu_si128((__m128i*)(out + done / 8 * 5), _mm_shuffle_epi8(x, gather));
+      done += 16;
+   }
+
+   return done + codec->tail_decode(codec, in + done, len - done, out + done / 8 * 5);
+}
+#endif
+
+static C64_Codec base64_codec = {
+   6, 3, 4, digits, '=', base64_bulk_encode, base64_bulk_decode
+};
+
+static C64_Codec base32_codec = {
+   5, 5, 8, "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567", '=', radix_bulk_encode, radix_bulk_decode,
+   { { 'A', 'Z', -'A' }, { 'a', 'z', -'a' }, { '2', '7', 26 - '2' } }
+};
+
+static C64_Codec base32hex_codec = {
+   5, 5, 8, "0123456789ABCDEFGHIJKLMNOPQRSTUV", '=', radix_bulk_encode, radix_bulk_decode,
+   { { '0', '9', -'0' }, { 'A', 'V', 10 - 'A' }, { 'a', 'v', 10 - 'a' } }
+};
+
+static C64_Codec base16_codec = {
+   4, 1, 2, "0123456789ABCDEF", '\0', radix_bulk_encode, radix_bulk_decode,
+   { { '0', '9', -'0' }, { 'A', 'F', 10 - 'A' }, { 'a', 'f', 10 - 'a' } }
+};
+
+/**
+ * @brief Build the decode table and select the bulk functions of
+ *        *codec*, for **prepare_codec**.
+ */
+C64_LOCAL void build_codec(C64_Codec *codec)
+{
+   unsigned int radix = 1 << codec->bits;
+
+   memset(codec->table, C64_INVALID, sizeof(codec->table));
+   for (unsigned int i=0; i < radix; ++i)
+   {
+      unsigned char digit = codec->alphabet[i];
+      codec->table[digit] = i;
+      if (radix < 64)
+         codec->table[tolower(digit)] = i;
+   }
+
+   if (codec->padding)
+      codec->table[(unsigned char)codec->padding] = C64_PADDING;
+
+   codec->tail_encode = codec->bits == 6 ? base64_bulk_encode : radix_bulk_encode;
+   codec->tail_decode = codec->bits == 6 ? base64_bulk_decode : radix_bulk_decode;
+
+#ifdef C64_X86
+   if (fast_bmi2())
+   {
+      codec->tail_encode = bmi2_bulk_encode;
+      codec->tail_decode = bmi2_bulk_decode;
+   }
+#endif
+
+   codec->bulk_encode = codec->tail_encode;
+   codec->bulk_decode = codec->tail_decode;
+
+#ifdef C64_X86
+   if (__builtin_cpu_supports("ssse3"))
+   {
+      if (codec->bits == 4)
+      {
+         codec->bulk_encode = base16_bulk_encode_ssse3;
+         codec->bulk_decode = base16_bulk_decode_ssse3;
+      }
+      else if (codec->bits == 5)
+      {
+         codec->bulk_encode = base32_bulk_encode_ssse3;
+         codec->bulk_decode = base32_bulk_decode_ssse3;
+      }
+   }
+#endif
+
+   atomic_store_explicit(&codec->ready, 1, memory_order_release);
+}
+
+/** Held while a codec is prepared, so that only one thread builds it. */
+static pthread_mutex_t codec_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Build the decode table and select the bulk functions of a
+ *        codec before its first use.
+ *
+ * Base16 and base32 digits are decoded in either case.  Base64 is
+ * prepared again after **c64_set_special_chars** changes its alphabet.
+ *
+ * Threads may call this at once on first use: one builds the codec
+ * under *codec_lock* while the others wait, and *ready* is set with
+ * release order, so a thread that finds it set sees the whole table.
+ */
+C64_LOCAL C64_Codec *prepare_codec(C64_Codec *codec)
+{
+   if (atomic_load_explicit(&codec->ready, memory_order_acquire))
+      return codec;
+
+   pthread_mutex_lock(&codec_lock);
+
+   if (!atomic_load_explicit(&codec->ready, memory_order_relaxed))
+      build_codec(codec);
 
-char digit62 = '+';
-char digit63 = '/';
-char padding_char = '=';
+   pthread_mutex_unlock(&codec_lock);
+   return codec;
+}
+
+C64_LOCAL const unsigned char *get_decode_table(void)
+{
+   return prepare_codec(&base64_codec)->table;
+}
 
-char byte_encode(unsigned int val)
+C64_LOCAL char byte_encode(unsigned int val)
 {
    assert(val < 64);
    return digits[val];
 }
 
-unsigned char digit_decode(char digit)
+C64_LOCAL unsigned char digit_decode(char digit)
 {
    if (digit >= 'A' && digit <= 'Z')
       return digit - 'A';
@@ -40,14 +707,9 @@ unsigned char digit_decode(char digit)
    }
 }
 
-int is_valid_encode_char(int val)
+C64_LOCAL int is_valid_encode_char(int val)
 {
-   if (val == padding_char)
-      return 1;
-   else if (strchr(digits, val)!=NULL)
-      return 1;
-   else
-      return 0;
+   return get_decode_table()[(unsigned char)val] != C64_INVALID;
 }
 
 /**
@@ -79,13 +741,26 @@ int is_valid_encode_char(int val)
  *                       62 and 63, and optionally, the third character
  *                       is to be used as the padding character for
  *                       incomplete byte triads.
+ *
+ * This function is not thread-safe.  It changes the alphabet of every
+ * base64 conversion, so call it before any thread encodes or decodes
+ * base64.  To decode input of several alphabets from different threads,
+ * use **c64_decode_detected_to_buffer**, which leaves these alone.
  */
-void c64_set_special_chars(const char* special_chars)
+C64_API void c64_set_special_chars(const char* special_chars)
 {
    assert(strlen(special_chars) > 1);
+
+   pthread_mutex_lock(&codec_lock);
+
    digits[62] = digit62 = special_chars[0];
    digits[63] = digit63 = special_chars[1];
    padding_char = special_chars[2];
+
+   base64_codec.padding = padding_char;
+   atomic_store_explicit(&base64_codec.ready, 0, memory_order_relaxed);
+
+   pthread_mutex_unlock(&codec_lock);
 }
 
 /**
@@ -99,7 +774,7 @@ void c64_set_special_chars(const char* special_chars)
  * to the end of the input string to ensure all significant
  * characters are decoded.
  */
-size_t c64_decoding_length(const char *input)
+C64_API size_t c64_decoding_length(const char *input)
 {
    size_t len = strlen(input);
 
@@ -121,7 +796,7 @@ size_t c64_decoding_length(const char *input)
  * The function adds space for string-terminating NULL, then rounds
  * up, if necessary, to ensure space for rational casting to uint32_t*.
  */
-size_t c64_encode_chars_needed(size_t input_size)
+C64_API size_t c64_encode_chars_needed(size_t input_size)
 {
    // Precise required memory needed to encode *input_size* bytes
    size_t bytes_needed = input_size / 3 * 4;
@@ -146,7 +821,7 @@ size_t c64_encode_chars_needed(size_t input_size)
  * the input length question.
  */
 
-size_t c64_decode_chars_needed(size_t input_size)
+C64_API size_t c64_decode_chars_needed(size_t input_size)
 {
    size_t extra = input_size % 4;
    return  input_size/4*3 + ( extra==0 ? 0 : ( extra==1 ? 1 : 2 ) );
@@ -158,7 +833,7 @@ size_t c64_decode_chars_needed(size_t input_size)
  * The returned value includes a final element in which the terminating \0
  * will be written to make, when cast as _const char*_, a traditional string.
  */
-size_t c64_encode_uint32s_needed(size_t input_size)
+C64_API size_t c64_encode_uint32s_needed(size_t input_size)
 {
    // Add extra uint32 for any remainder.
    // Then, since the output is a string, and padding
@@ -168,42 +843,12 @@ size_t c64_encode_uint32s_needed(size_t input_size)
    return input_size/3 + ((input_size % 3)>0) + 1;
 }
 
-size_t c64_decode_uint32s_needed(size_t input_size)
+C64_API size_t c64_decode_uint32s_needed(size_t input_size)
 {
    input_size *= 3;
    return input_size / 4 + ((input_size % 4)>0);
 }
 
-/**
- * @brief Decoding utility function that discards unrecognized characters
- *        (characters that are neither base64 digits or the padding character)
- *        wwhile filling an input buffer.
- */
-int read_but_skip_invalid(FILE *in, void* buffer, size_t len)
-{
-   size_t bread=0, tread=0;
-   char *buff = (char*)buffer;
-   char *cur;
-
-   while (tread < len)
-   {
-      cur = &buff[tread];
-      bread = fread(cur, 1, 1, in);
-      if (bread)
-      {
-         if (is_valid_encode_char(*cur))
-         {
-            ++cur;
-            ++tread;
-         }
-      }
-      else
-         break;
-   }
-
-   return tread;
-}
-
 /**
  * @brief Encoded chars reader that discards invalid characters while filling a buffer for decoding.
  *
@@ -218,7 +863,7 @@ int read_but_skip_invalid(FILE *in, void* buffer, size_t len)
  * @return Number of chars considered, invalid or not.  Advance the input buffer
  *         by this number of characters to continue decoding.
  */
-int scan_but_skip_invalid(const char *input, char* buffer, size_t buffer_len)
+C64_LOCAL int scan_but_skip_invalid(const char *input, char* buffer, size_t buffer_len)
 {
    const char *ptr_input = input;
    size_t tread=0;
@@ -251,7 +896,7 @@ int scan_but_skip_invalid(const char *input, char* buffer, size_t buffer_len)
  * I am insisting on using uint32 for the output buffer to take
  * advantage, however small, of using integer-aligned variables.
  */
-const char *c64_encode_to_pointer(const char *input, int count, uint32_t *buff_var)
+C64_API const char *c64_encode_to_pointer(const char *input, int count, uint32_t *buff_var)
 {
    const unsigned char *ptr = (const unsigned char*)input;
    const unsigned char *end = ptr + count;
@@ -262,6 +907,16 @@ const char *c64_encode_to_pointer(const char *input, int count, uint32_t *buff_v
 
    char *output_buff = (char*)buff_var;
 
+#ifdef C64_X86
+   // A complete triad in one step if the codec selected BMI2:
+   const C64_Codec *codec = prepare_codec(&base64_codec);
+   if (count == 3 && codec->tail_encode == bmi2_bulk_encode)
+   {
+      bmi2_encode_triad(codec, ptr, output_buff);
+      return (const char *)buff_var;
+   }
+#endif
+
    /* // Preload buffer with "\0\0==" to in case of short input (less than 3 characters) */
    /* *buff_var = *(uint32_t*)"\0\0=="; */
 
@@ -302,7 +957,7 @@ const char *c64_encode_to_pointer(const char *input, int count, uint32_t *buff_v
  *
  * This function consumes **input** 4 characters at a time.
  */
-int c64_decode_to_pointer(const char *input, uint32_t *buff_val)
+C64_API int c64_decode_to_pointer(const char *input, uint32_t *buff_val)
 {
    // Abort without copying if first character end-of-string
    if (*input==0)
@@ -311,6 +966,15 @@ int c64_decode_to_pointer(const char *input, uint32_t *buff_val)
    uint32_t working = *buff_val = 0;
    char *buff_alias = (char*)buff_val;
 
+#ifdef C64_X86
+   // Four digits in one step if the codec selected BMI2.  Padding and
+   // other characters take the path below:
+   const C64_Codec *codec = prepare_codec(&base64_codec);
+   if (codec->tail_decode == bmi2_bulk_decode
+       && bmi2_decode_quad(codec, (const unsigned char*)input, (unsigned char*)buff_alias))
+      return 1;
+#endif
+
    // pack the bits into 3 bytes of a uint32
    for (int i=26; i>6; i-=6)
    {
@@ -344,13 +1008,15 @@ int c64_decode_to_pointer(const char *input, uint32_t *buff_val)
  * Use function **c64_encode_uint32s_needed()** to get the length needed
  * for the uint32 buffer.
  */
-void c64_encode_to_buffer(const char *input, size_t len_input, uint32_t *buffer, int bufflen)
+C64_API void c64_encode_to_buffer(const char *input, size_t len_input, uint32_t *buffer, int bufflen)
 {
    const char *ptr_in = input;
    const char *in_end = input + len_input;
 
    uint32_t *ptr_out = buffer;
 
+   C64_PROBE2(encode_entry, 6, len_input);
+
    // Send end back 1 uint32_t (4 bytes) to ensure there
    // is room for four bytes can be copied to the pointer.
    uint32_t *end_out = ptr_out + bufflen - 1;
@@ -375,98 +1041,3109 @@ void c64_encode_to_buffer(const char *input, size_t len_input, uint32_t *buffer,
 
    if (ptr_out < end_out)
       *ptr_out = 0;
+
+   C64_PROBE2(encode_return, 6, (ptr_out - buffer) * 4);
 }
 
 /**
- * @brief Source and target are FILE streams.
+ * @brief Encode a block of bytes, including a padded final remainder.
  *
- * The inspiration for this function is to support the use of this
- * library with a command-line program that can supply the input
- * from stdin or a named file, with output, likewise, going to stdout
- * or another named file.
+ * Complete groups go to the codec's bulk function, so *len* should be a
+ * multiple of the group size except for the last block of the data.
  *
- * @param in      FILE stream pointer for input file.
- * @param out     FILE stream pointer for output file.
- * @param breaks  Characters to print per line.  Must be 0 or multiple of 4.
- *                Values outside of restrictions will print unbalanced lines.
+ * @return Number of characters written to *out*.
  */
-void c64_encode_stream_to_stream(FILE *in, FILE *out, unsigned int breaks)
+C64_LOCAL size_t encode_groups(const C64_Codec *codec, const unsigned char *in, size_t len, char *out)
 {
-   uint32_t reading = 0;
-   uint32_t working;
-   size_t total_read = 0, total_written = 0;
+   size_t done = codec->bulk_encode(codec, in, len, out);
+   char *ptr = out + done / codec->group_bytes * codec->group_chars;
 
-   size_t bytes_read, bytes_written;
+   size_t remainder = len - done;
+   if (remainder)
+   {
+      uint64_t working = 0;
+      for (size_t i=0; i < remainder; ++i)
+         working = (working << 8) | in[done + i];
 
-   while ((bytes_read = fread((void*)&reading, 1, 3, in)) > 0)
+      // Left-align the remaining bits to a whole number of digits:
+      unsigned int chars = (remainder * 8 + codec->bits - 1) / codec->bits;
+      working <<= chars * codec->bits - remainder * 8;
+
+      for (unsigned int i = chars; i-- > 0; )
+         *ptr++ = codec->alphabet[(working >> (i * codec->bits)) & ((1 << codec->bits) - 1)];
+
+      if (codec->padding)
+         for (unsigned int i = chars; i < codec->group_chars; ++i)
+            *ptr++ = codec->padding;
+   }
+
+   return ptr - out;
+}
+
+/**
+ * @brief Characters between line breaks for a *breaks* value.
+ *
+ * Line breaks are written after a group brings the output to a multiple
+ * of *breaks*, so a *breaks* value that is not a multiple of the group
+ * size breaks lines at the least common multiple of the two.
+ */
+C64_LOCAL unsigned int line_chars_from_breaks(unsigned int breaks, unsigned int group_chars)
+{
+   unsigned int a = breaks, b = group_chars, t;
+
+   if (!breaks)
+      return 0;
+
+   while (b)
    {
-      total_read += bytes_read;
-      c64_encode_to_pointer((const char*)&reading, bytes_read, &working);
+      t = a % b;
+      a = b;
+      b = t;
+   }
+
+   return breaks / a * group_chars;
+}
+
+/**
+ * @brief Encode a block, inserting "\r\n" every *line_chars* characters.
+ *
+ * @param column  Characters written to the current line.  It is updated
+ *                so that lines continue across consecutive blocks.
+ *
+ * @return Number of characters written to *out*.
+ */
+C64_LOCAL size_t encode_lines(const C64_Codec *codec, const unsigned char *in, size_t len, char *out,
+                              unsigned int line_chars, unsigned int *column)
+{
+   if (!line_chars)
+      return encode_groups(codec, in, len, out);
+
+   char *ptr = out;
 
-      bytes_written = fwrite((void*)&working, 1, 4, out);
+   while (len > 0)
+   {
+      size_t line_bytes = (line_chars - *column) / codec->group_chars * codec->group_bytes;
+      if (line_bytes > len)
+         line_bytes = len;
 
-      total_written += bytes_written;
+      size_t written = encode_groups(codec, in, line_bytes, ptr);
+      ptr += written;
+      *column += written;
 
-      if (breaks && total_written && (total_written % breaks)==0 )
-         fwrite((void*)"\r\n", 1, 2, out);
+      if (*column >= line_chars)
+      {
+         *ptr++ = '\r';
+         *ptr++ = '\n';
+         *column = 0;
+      }
 
-      reading = 0;
+      in += line_bytes;
+      len -= line_bytes;
    }
+
+   return ptr - out;
 }
 
 /**
- * @brief Decode encoded string to caller-provided buffer, which can be used upon return.
+ * @brief Write the bytes of an incomplete group that ended with
+ *        padding or with the end of the input.
+ *
+ * Bits left over that do not make up a complete byte are discarded.
  */
-void c64_decode_to_buffer(const char *input, char *buffer, size_t len)
+C64_LOCAL size_t flush_group(const C64_Codec *codec, C64_Decode_State *state, unsigned char *out)
 {
-   size_t in_len = c64_decoding_length(input);
-   const char *in_end = input + in_len;
+   unsigned int total_bits = state->count * codec->bits;
+   size_t written = total_bits / 8;
+   uint64_t bits = state->bits >> (total_bits % 8);
 
-   assert(len >= c64_decode_chars_needed(in_len));
+   for (size_t i = written; i-- > 0; )
+   {
+      out[i] = bits;
+      bits >>= 8;
+   }
 
-   char *out_ptr = buffer;
-   uint32_t working;
-   char encoded_buffer[5];
+   state->bits = 0;
+   state->count = 0;
+   return written;
+}
 
-   const char *ptr = input;
-   while(ptr < in_end)
+/**
+ * @brief Decode a block of characters, skipping characters that
+ *        are neither digits nor padding.
+ *
+ * Runs of complete groups go to the codec's bulk function.  A character
+ * outside of the alphabet drops into a per-character path that skips
+ * it.  Digits of a group that is incomplete at the end of the block are
+ * saved in *state* to be completed by the next block.
+ *
+ * @return Number of bytes written to *out*.
+ */
+C64_LOCAL size_t decode_groups(const C64_Codec *codec, const unsigned char *in, size_t len,
+                               unsigned char *out, C64_Decode_State *state)
+{
+   const unsigned char *table = codec->table;
+   const unsigned char *end = in + len;
+   unsigned char *ptr = out;
+   unsigned char val;
+
+   while (in < end)
    {
-      ptr += scan_but_skip_invalid(ptr, encoded_buffer, sizeof(encoded_buffer));
+      if (state->count == 0)
+      {
+         size_t done = codec->bulk_decode(codec, in, end - in, ptr);
+         in += done;
+         ptr += done / codec->group_chars * codec->group_bytes;
 
-      if (!c64_decode_to_pointer(encoded_buffer, &working))
-         break;
+         if (in == end)
+            break;
+      }
 
-      memcpy(out_ptr, (void*)&working, 3);
+      val = table[*in++];
+      if (val < C64_PADDING)
+      {
+         state->bits = (state->bits << codec->bits) | val;
+         if (++state->count == codec->group_chars)
+         {
+            for (unsigned int i = codec->group_bytes; i-- > 0; )
+            {
+               ptr[i] = state->bits;
+               state->bits >>= 8;
+            }
+            ptr += codec->group_bytes;
+            state->bits = 0;
+            state->count = 0;
+         }
+      }
+      else if (val == C64_PADDING)
+         ptr += flush_group(codec, state, ptr);
+      else
+         C64_PROBE2(skip_invalid, codec->bits, in[-1]);
+   }
 
-      out_ptr += 3;
+   return ptr - out;
+}
+
+/**
+ * @brief Line layout of encoded input, found by **detect_lines**.
+ *
+ * *width* is 0 unless every line seems to hold the same number of
+ * complete groups, which is the case for MIME, PEM, and anything else
+ * encoded with a fixed line length.
+ */
+typedef struct _C64_Lines
+{
+   unsigned int width;          // digits per line
+   unsigned int term_len;       // 2 for "\r\n", 1 for "\n"
+} C64_Lines;
+
+/**
+ * @brief Take the line width and terminator from the first complete
+ *        line of *in*, the characters between its first two newlines.
+ *
+ * The first line is not used alone because *in* may begin in the middle
+ * of a line.  A guess that turns out to be wrong costs little, because
+ * **decode_lines** checks every line before it takes the fast path.
+ */
+C64_LOCAL void detect_lines(const C64_Codec *codec, const unsigned char *in, size_t len, C64_Lines *lines)
+{
+   const unsigned char *end = in + len;
+   const unsigned char *first = memchr(in, '\n', len);
+   const unsigned char *second = first ? memchr(first + 1, '\n', end - first - 1) : NULL;
+
+   lines->width = 0;
+   lines->term_len = 1;
+
+   if (second)
+   {
+      if (second[-1] == '\r')
+         lines->term_len = 2;
+
+      size_t width = second - first - lines->term_len;
+      if (width > 0 && width % codec->group_chars == 0 && width < 0x10000)
+         lines->width = width;
    }
 }
+
 /**
- * @brief Source and target are FILE streams.
+ * @brief Decode a block of fixed-width lines without looking for the
+ *        line breaks.
  *
- * The inspiration for this function is to support the use of this
- * library with a command-line program that can supply the input
- * from stdin or a named file, with output, likewise, going to stdout
- * or another named file.
+ * At the start of a line, with no incomplete group pending, a line that
+ * ends with the expected terminator is given whole to the codec's bulk
+ * function.  If the bulk function converts all of it, every character
+ * was a digit, and the terminator is skipped at its known offset.  A
+ * line that does not fit, like the last, a short one, or one with
+ * padding or other characters, goes through **decode_groups** up to
+ * the next newline, after which the fast path resumes.  The result is
+ * the same as that of **decode_groups** for any input.
+ *
+ * @return Number of bytes written to *out*.
  */
-void c64_decode_stream_to_stream(FILE *in, FILE *out)
+C64_LOCAL size_t decode_lines(const C64_Codec *codec, const unsigned char *in, size_t len,
+                              unsigned char *out, C64_Decode_State *state, const C64_Lines *lines)
 {
-   uint32_t reading = 0;
-   uint32_t working;
-   size_t total_read = 0, total_written = 0;
+   if (!lines->width)
+      return decode_groups(codec, in, len, out, state);
 
-   size_t bytes_read, bytes_written;
+   const unsigned char *end = in + len;
+   unsigned char *ptr = out;
+   size_t width = lines->width;
+   size_t stride = width + lines->term_len;
+   size_t line_bytes = width / codec->group_chars * codec->group_bytes;
 
-   while ((bytes_read = read_but_skip_invalid(in, (void*)&reading, sizeof(reading))))
-   /* while ((bytes_read = fread((void*)&reading, 1, 4, in)) > 0) */
+   while (in < end)
    {
-      total_read += bytes_read;
-      c64_decode_to_pointer((const char*)&reading, &working);
-      bytes_written = fwrite((void*)&working, 1, 3, out);
-      total_written += bytes_written;
+      if (state->count == 0)
+      {
+         while ((size_t)(end - in) >= stride
+                && in[stride - 1] == '\n'
+                && (lines->term_len == 1 || in[width] == '\r')
+                && codec->bulk_decode(codec, in, width, ptr) == width)
+         {
+            in += stride;
+            ptr += line_bytes;
+         }
+      }
+
+      const unsigned char *newline = memchr(in, '\n', end - in);
+      const unsigned char *stop = newline ? newline + 1 : end;
+
+      ptr += decode_groups(codec, in, stop - in, ptr, state);
+      in = stop;
+   }
+
+   return ptr - out;
+}
+
+/**
+ * Payloads of at least this many bytes are written with non-temporal
+ * stores that bypass the cache, so that converting them does not evict
+ * the working sets of other threads.  0 until the first use, when it is
+ * set to half of the last-level cache.  Atomic, as threads converting
+ * at once may all set it on first use, to the same value.
+ */
+static atomic_size_t large_threshold = 0;
+
+/** Conversions of large payloads go through a staging block of this many input bytes. */
+#define C64_STAGE_SIZE C64_BLOCK_SIZE
+
+/** Size and alignment of transparent huge pages on x86-64. */
+#define C64_HUGE_PAGE (2 * 1024 * 1024)
+
+/**
+ * @brief Set the payload size from which the buffer functions and the
+ *        memory writer use non-temporal stores.
+ *
+ * @param bytes  Threshold in bytes, 0 for half of the last-level cache
+ *               (the default), or SIZE_MAX to never bypass the cache.
+ */
+C64_API void c64_set_large_threshold(size_t bytes)
+{
+   if (bytes == 0)
+   {
+      long cache = sysconf(_SC_LEVEL3_CACHE_SIZE);
+      bytes = cache > 0 ? (size_t)cache / 2 : 4 * 1024 * 1024;
+   }
+
+   atomic_store_explicit(&large_threshold, bytes, memory_order_relaxed);
+}
+
+C64_LOCAL int is_large(size_t bytes)
+{
+   if (!atomic_load_explicit(&large_threshold, memory_order_relaxed))
+      c64_set_large_threshold(0);
+
+   return bytes >= atomic_load_explicit(&large_threshold, memory_order_relaxed);
+}
+
+/**
+ * @brief Prefetch *len* bytes from *ptr* with the non-temporal hint,
+ *        which keeps them out of the outer levels of the cache.
+ */
+C64_LOCAL void prefetch_stream(const void *ptr, size_t len)
+{
+   for (size_t offset = 0; offset < len; offset += 64)
+      __builtin_prefetch((const char*)ptr + offset, 0, 0);
+}
+
+/**
+ * @brief Copy with non-temporal stores, which write *dst* to memory
+ *        without reading it into the cache or evicting anything.
+ *
+ * The unaligned ends are copied normally.  Ends with a store fence, so
+ * the data is visible to other threads when this returns.
+ */
+C64_LOCAL void stream_copy(void *dst, const void *src, size_t len)
+{
+#ifdef C64_X86
+   unsigned char *to = (unsigned char*)dst;
+   const unsigned char *from = (const unsigned char*)src;
+   size_t head = (16 - ((uintptr_t)to & 15)) & 15;
+
+   if (head > len)
+      head = len;
+
+   memcpy(to, from, head);
+   to += head;
+   from += head;
+   len -= head;
+
+   for (; len >= 64; len -= 64, to += 64, from += 64)
+   {
+      __m128i a = _mm_loadu_si128((const __m128i*)from);
+      __m128i b = _mm_loadu_si128((const __m128i*)(from + 16));
+      __m128i c = _mm_loadu_si128((const __m128i*)(from + 32));
+      __m128i d = _mm_loadu_si128((const __m128i*)(from + 48));
+      _mm_stream_si128((__m128i*)to, a);
+      _mm_stream_si128((__m128i*)(to + 16), b);
+      _mm_stream_si128((__m128i*)(to + 32), c);
+      _mm_stream_si128((__m128i*)(to + 48), d);
+   }
+
+   for (; len >= 16; len -= 16, to += 16, from += 16)
+      _mm_stream_si128((__m128i*)to, _mm_loadu_si128((const __m128i*)from));
+
+   memcpy(to, from, len);
+   _mm_sfence();
+#else
+   memcpy(dst, src, len);
+#endif
+}
+
+/**
+ * @brief Allocate a buffer for large payloads, aligned to and backed
+ *        by transparent huge pages where the kernel allows it.
+ *
+ * Huge pages cut the TLB misses of a pass over hundreds of megabytes.
+ * Release the buffer with **c64_free_large**.
+ *
+ * @return The buffer, or NULL if it could not be allocated.
+ */
+C64_API void *c64_alloc_large(size_t size)
+{
+   // Map a huge page more than needed, to trim to an aligned start:
+   size_t length = (size + C64_HUGE_PAGE - 1) & ~(size_t)(C64_HUGE_PAGE - 1);
+   size_t mapped = length + C64_HUGE_PAGE;
+   char *map = (char*)mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (map == MAP_FAILED)
+      return NULL;
+
+   char *start = (char*)(((uintptr_t)map + C64_HUGE_PAGE - 1) & ~(uintptr_t)(C64_HUGE_PAGE - 1));
+   size_t before = start - map;
+
+   if (before)
+      munmap(map, before);
+   if (mapped - before > length)
+      munmap(start + length, mapped - before - length);
+
+#ifdef MADV_HUGEPAGE
+   madvise(start, length, MADV_HUGEPAGE);
+#endif
+   return start;
+}
+
+/** @brief Release a buffer of *size* bytes from **c64_alloc_large**. */
+C64_API void c64_free_large(void *buffer, size_t size)
+{
+   if (buffer)
+      munmap(buffer, (size + C64_HUGE_PAGE - 1) & ~(size_t)(C64_HUGE_PAGE - 1));
+}
+
+/** Reader and writer functions of the built-in adapters. */
+C64_LOCAL ssize_t file_read(void *context, void *buffer, size_t len)
+{
+   size_t bytes_read = fread(buffer, 1, len, (FILE*)context);
+   return bytes_read == 0 && ferror((FILE*)context) ? -1 : (ssize_t)bytes_read;
+}
+
+C64_LOCAL ssize_t file_write(void *context, const void *data, size_t len)
+{
+   return fwrite(data, 1, len, (FILE*)context);
+}
+
+C64_LOCAL ssize_t fd_read(void *context, void *buffer, size_t len)
+{
+   ssize_t bytes_read;
+   while ((bytes_read = read((int)(intptr_t)context, buffer, len)) < 0 && errno == EINTR)
+      ;
+   return bytes_read;
+}
+
+/** Pipes and sockets may take less than all of the data at a time. */
+C64_LOCAL ssize_t fd_write(void *context, const void *data, size_t len)
+{
+   const char *ptr = (const char*)data;
+   size_t left = len;
+
+   while (left > 0)
+   {
+      ssize_t written = write((int)(intptr_t)context, ptr, left);
+      if (written < 0 && errno == EINTR)
+         continue;
+      if (written <= 0)
+         return -1;
+      ptr += written;
+      left -= written;
+   }
+
+   return len;
+}
 
-      reading = 0;
+C64_LOCAL ssize_t memory_read(void *context, void *buffer, size_t len)
+{
+   C64_Memory *memory = (C64_Memory*)context;
+   size_t left = memory->size - memory->position;
+
+   if (len > left)
+      len = left;
+
+   memcpy(buffer, memory->data + memory->position, len);
+   memory->position += len;
+   return len;
+}
+
+C64_LOCAL ssize_t memory_write(void *context, const void *data, size_t len)
+{
+   C64_Memory *memory = (C64_Memory*)context;
+
+   if (len > memory->size - memory->position)
+   {
+      if (!memory->growable)
+         return -1;
+
+      size_t size = memory->size ? memory->size : 4096;
+      while (len > size - memory->position)
+         size *= 2;
+
+      char *grown = (char*)realloc(memory->data, size);
+      if (!grown)
+         return -1;
+
+      memory->data = grown;
+      memory->size = size;
+   }
+
+   if (is_large(memory->size))
+      stream_copy(memory->data + memory->position, data, len);
+   else
+      memcpy(memory->data + memory->position, data, len);
+
+   memory->position += len;
+   return len;
+}
+
+/** @brief Reader of a FILE stream. */
+C64_API C64_Reader c64_file_reader(FILE *file)
+{
+   C64_Reader reader = { file_read, file };
+   return reader;
+}
+
+/** @brief Writer to a FILE stream. */
+C64_API C64_Writer c64_file_writer(FILE *file)
+{
+   C64_Writer writer = { file_write, file };
+   return writer;
+}
+
+/** @brief Reader of a file descriptor, such as a pipe or socket, without stdio. */
+C64_API C64_Reader c64_fd_reader(int fd)
+{
+   C64_Reader reader = { fd_read, (void*)(intptr_t)fd };
+   return reader;
+}
+
+/** @brief Writer to a file descriptor, without stdio. */
+C64_API C64_Writer c64_fd_writer(int fd)
+{
+   C64_Writer writer = { fd_write, (void*)(intptr_t)fd };
+   return writer;
+}
+
+/**
+ * @brief Reader of the bytes of *memory* from *memory->position* up to
+ *        *memory->size*.
+ *
+ * The stream functions convert straight from the memory rather than
+ * copying it through a buffer, so a file mapped with mmap is converted
+ * without being read at all.
+ */
+C64_API C64_Reader c64_memory_reader(C64_Memory *memory)
+{
+   C64_Reader reader = { memory_read, memory };
+   return reader;
+}
+
+/**
+ * @brief Writer to *memory* at *memory->position*, failing at
+ *        *memory->size*, or if *memory->growable* is set, enlarging
+ *        *memory->data* with realloc.
+ */
+C64_API C64_Writer c64_memory_writer(C64_Memory *memory)
+{
+   C64_Writer writer = { memory_write, memory };
+   return writer;
+}
+
+/**
+ * @brief Get the next block of up to *len* bytes from *in*, filling
+ *        *buffer* completely unless the input ends.
+ *
+ * Readers like pipes deliver arbitrary amounts at a time, but the
+ * encoders need whole groups in every block but the last.  The data
+ * of a memory reader is used where it is, without copying it to
+ * *buffer*.
+ *
+ * @return Number of bytes at **block*, 0 at the end of the input, or
+ *         -1 if the reader failed.
+ */
+C64_LOCAL ssize_t next_block(C64_Reader *in, unsigned char *buffer, size_t len, const unsigned char **block)
+{
+   size_t filled = 0;
+   ssize_t bytes_read;
+
+   if (in->read == memory_read)
+   {
+      C64_Memory *memory = (C64_Memory*)in->context;
+      size_t left = memory->size - memory->position;
+
+      if (len > left)
+         len = left;
+
+      *block = (const unsigned char*)memory->data + memory->position;
+      memory->position += len;
+
+      // Fetch the next block while this one is converted:
+      if (is_large(memory->size))
+         prefetch_stream(*block + len, left - len < len ? left - len : len);
+
+      return len;
+   }
+
+   *block = buffer;
+   while (filled < len && (bytes_read = in->read(in->context, buffer + filled, len - filled)) != 0)
+   {
+      if (bytes_read < 0)
+         return -1;
+      filled += bytes_read;
    }
+
+   return filled;
 }
 
+/** @return 0, or -1 if *out* did not take all of the data. */
+C64_LOCAL int write_block(C64_Writer *out, const void *data, size_t len)
+{
+   return len == 0 || out->write(out->context, data, len) == (ssize_t)len ? 0 : -1;
+}
 
+/**
+ * @brief Stream encoding shared by all codecs.
+ *
+ * Each block is checksummed just before it is encoded, while it is
+ * still in the cache, so the data is only read from memory once.
+ *
+ * @return 0, or -1 if reading or writing failed.
+ */
+C64_LOCAL int encode_stream(const C64_Codec *codec, C64_Reader *in, C64_Writer *out,
+                            unsigned int breaks, uint32_t *crc)
+{
+   unsigned char inbuff[C64_BLOCK_SIZE];
+   // Room for base16 with a line break after every 2 characters:
+   char outbuff[C64_BLOCK_SIZE * 4];
+
+   unsigned int line_chars = line_chars_from_breaks(breaks, codec->group_chars);
+   unsigned int column = 0;
+   const unsigned char *block;
+   ssize_t bytes_read;
+   size_t bytes_encoded;
+   uint64_t total_read = 0, total_written = 0;
+   int result = 0;
+
+   C64_PROBE1(stream_encode_entry, codec->bits);
+
+   while (result == 0 && (bytes_read = next_block(in, inbuff, sizeof(inbuff), &block)) > 0)
+   {
+      C64_PROBE1(block_read, bytes_read);
+
+      if (crc)
+         *crc = c64_crc32c(*crc, block, bytes_read);
+
+      bytes_encoded = encode_lines(codec, block, bytes_read, outbuff, line_chars, &column);
+      result = write_block(out, outbuff, bytes_encoded);
+
+      C64_PROBE1(block_write, bytes_encoded);
+      total_read += bytes_read;
+      total_written += bytes_encoded;
+   }
+
+   if (bytes_read < 0)
+      result = -1;
+
+   C64_PROBE3(stream_encode_return, codec->bits, total_read, total_written);
+   return result;
+}
+
+/**
+ * @brief Sets of special characters that auto-detection chooses among,
+ *        and the base64 codec it builds for the one chosen.
+ */
+typedef struct _C64_Detect
+{
+   const char *const *candidates;
+   unsigned int count;
+   int chosen;                  // index of the chosen candidate
+   char alphabet[65];
+   C64_Codec codec;
+} C64_Detect;
+
+C64_LOCAL const C64_Codec *detect_codec(C64_Detect *detect, const unsigned char *in, size_t len);
+
+/**
+ * @brief Stream decoding shared by all codecs.
+ *
+ * With *detect*, the base64 alphabet is chosen by the special
+ * characters of the first block, which is then decoded with it like
+ * the rest, so the input is still read only once.
+ *
+ * @return 0, or -1 if reading or writing failed.
+ */
+C64_LOCAL int decode_stream(const C64_Codec *codec, C64_Reader *in, C64_Writer *out, uint32_t *crc,
+                            C64_Detect *detect)
+{
+   unsigned char inbuff[C64_BLOCK_SIZE];
+   // No codec decodes to more bytes than characters, plus a group
+   // of slack for flushing and for SIMD stores:
+   unsigned char outbuff[C64_BLOCK_SIZE + 16];
+
+   C64_Decode_State state = { 0, 0 };
+   C64_Lines lines = { 0, 0 };
+   const unsigned char *block;
+   ssize_t bytes_read;
+   size_t bytes_decoded;
+   uint64_t total_read = 0, total_written = 0;
+   int first_block = 1;
+   int result = 0;
+
+   C64_PROBE1(stream_decode_entry, codec->bits);
+
+   while (result == 0 && (bytes_read = next_block(in, inbuff, sizeof(inbuff), &block)) > 0)
+   {
+      C64_PROBE1(block_read, bytes_read);
+
+      if (first_block)
+      {
+         if (detect)
+            codec = detect_codec(detect, block, bytes_read);
+
+         detect_lines(codec, block, bytes_read, &lines);
+         first_block = 0;
+      }
+
+      bytes_decoded = decode_lines(codec, block, bytes_read, outbuff, &state, &lines);
+
+      if (crc)
+         *crc = c64_crc32c(*crc, outbuff, bytes_decoded);
+
+      result = write_block(out, outbuff, bytes_decoded);
+
+      C64_PROBE1(block_write, bytes_decoded);
+      total_read += bytes_read;
+      total_written += bytes_decoded;
+   }
+
+   if (bytes_read < 0)
+      result = -1;
+
+   // Unpadded input may end with an incomplete group:
+   if (result == 0 && (bytes_decoded = flush_group(codec, &state, outbuff)))
+   {
+      if (crc)
+         *crc = c64_crc32c(*crc, outbuff, bytes_decoded);
+
+      result = write_block(out, outbuff, bytes_decoded);
+
+      C64_PROBE1(block_write, bytes_decoded);
+      total_written += bytes_decoded;
+   }
+
+   C64_PROBE3(stream_decode_return, codec->bits, total_read, total_written);
+   return result;
+}
+
+/**
+ * @brief Source and target are FILE streams.
+ *
+ * The inspiration for this function is to support the use of this
+ * library with a command-line program that can supply the input
+ * from stdin or a named file, with output, likewise, going to stdout
+ * or another named file.
+ *
+ * @param in      FILE stream pointer for input file.
+ * @param out     FILE stream pointer for output file.
+ * @param breaks  Characters to print per line.  Must be 0 or multiple of 4.
+ *                Values outside of restrictions will print unbalanced lines.
+ */
+C64_API void c64_encode_stream_to_stream(FILE *in, FILE *out, unsigned int breaks)
+{
+   c64_encode_stream_to_stream_crc(in, out, breaks, NULL);
+}
+
+/**
+ * @brief Encode stream to stream while computing the CRC32C of the input.
+ *
+ * Each block is checksummed just before it is encoded, while it is
+ * still in the cache, so the data is only read from memory once.
+ *
+ * @param crc  If not NULL, a running CRC32C value (0 for a new checksum)
+ *             that is updated with the bytes read from *in*.
+ */
+C64_API void c64_encode_stream_to_stream_crc(FILE *in, FILE *out, unsigned int breaks, uint32_t *crc)
+{
+   C64_Reader reader = c64_file_reader(in);
+   C64_Writer writer = c64_file_writer(out);
+
+   encode_stream(prepare_codec(&base64_codec), &reader, &writer, breaks, crc);
+}
+
+/**
+ * @brief Decode encoded string to caller-provided buffer, which can be used upon return.
+ */
+C64_API void c64_decode_to_buffer(const char *input, char *buffer, size_t len)
+{
+   size_t in_len = c64_decoding_length(input);
+   const char *in_end = input + in_len;
+
+   assert(len >= c64_decode_chars_needed(in_len));
+
+   char *out_ptr = buffer;
+   uint32_t working;
+   char encoded_buffer[5];
+
+   C64_PROBE2(decode_entry, 6, in_len);
+
+   const char *ptr = input;
+   while(ptr < in_end)
+   {
+      ptr += scan_but_skip_invalid(ptr, encoded_buffer, sizeof(encoded_buffer));
+
+      if (!c64_decode_to_pointer(encoded_buffer, &working))
+         break;
+
+      memcpy(out_ptr, (void*)&working, 3);
+
+      out_ptr += 3;
+   }
+
+   C64_PROBE2(decode_return, 6, out_ptr - buffer);
+}
+/**
+ * @brief Source and target are FILE streams.
+ *
+ * The inspiration for this function is to support the use of this
+ * library with a command-line program that can supply the input
+ * from stdin or a named file, with output, likewise, going to stdout
+ * or another named file.
+ */
+C64_API void c64_decode_stream_to_stream(FILE *in, FILE *out)
+{
+   c64_decode_stream_to_stream_crc(in, out, NULL);
+}
+
+/**
+ * @brief Decode stream to stream while computing the CRC32C of the output.
+ *
+ * @param crc  If not NULL, a running CRC32C value (0 for a new checksum)
+ *             that is updated with the decoded bytes written to *out*.
+ */
+C64_API void c64_decode_stream_to_stream_crc(FILE *in, FILE *out, uint32_t *crc)
+{
+   C64_Reader reader = c64_file_reader(in);
+   C64_Writer writer = c64_file_writer(out);
+
+   decode_stream(prepare_codec(&base64_codec), &reader, &writer, crc, NULL);
+}
+
+C64_LOCAL C64_Codec *get_radix_codec(C64_Radix radix)
+{
+   switch (radix)
+   {
+      case C64_BASE32:
+         return prepare_codec(&base32_codec);
+      case C64_BASE32HEX:
+         return prepare_codec(&base32hex_codec);
+      case C64_BASE16:
+         return prepare_codec(&base16_codec);
+      default:
+         return prepare_codec(&base64_codec);
+   }
+}
+
+/**
+ * @brief Returns the number of bytes needed to encode *input_size* bytes
+ *        in *radix*, including padding and a string-terminating NULL.
+ */
+C64_API size_t c64_radix_encode_chars_needed(C64_Radix radix, size_t input_size)
+{
+   const C64_Codec *codec = get_radix_codec(radix);
+   size_t groups = (input_size + codec->group_bytes - 1) / codec->group_bytes;
+   return groups * codec->group_chars + 1;
+}
+
+/**
+ * @brief Returns the number of bytes guaranteed to be enough to contain
+ *        the decoding of *input_size* characters in *radix*.
+ */
+C64_API size_t c64_radix_decode_chars_needed(C64_Radix radix, size_t input_size)
+{
+   const C64_Codec *codec = get_radix_codec(radix);
+   return input_size / codec->group_chars * codec->group_bytes
+      + input_size % codec->group_chars * codec->bits / 8;
+}
+
+/**
+ * @brief Encode a large payload a block at a time into a staging
+ *        buffer that stays in the cache, streaming each block out to
+ *        *out* with non-temporal stores.
+ *
+ * The output of every block but the last is a multiple of 16 bytes, so
+ * if *out* is aligned, all of it is written with non-temporal stores.
+ *
+ * @return Number of characters written to *out*.
+ */
+C64_LOCAL size_t encode_large(const C64_Codec *codec, const unsigned char *in, size_t len, char *out)
+{
+   // Room for base16, plus a padded final group:
+   char stage[C64_STAGE_SIZE * 2 + 16];
+   size_t written = 0;
+
+   for (size_t done = 0; done < len; done += C64_STAGE_SIZE)
+   {
+      size_t block = len - done < C64_STAGE_SIZE ? len - done : C64_STAGE_SIZE;
+
+      prefetch_stream(in + done + block, len - done - block < block ? len - done - block : block);
+      size_t chars = encode_groups(codec, in + done, block, stage);
+      stream_copy(out + written, stage, chars);
+      written += chars;
+   }
+
+   return written;
+}
+
+/**
+ * @brief Decode a large payload a block at a time through a staging
+ *        buffer, like **encode_large**.
+ *
+ * @return Number of bytes written to *out*, not counting an incomplete
+ *         group left in *state*.
+ */
+C64_LOCAL size_t decode_large(const C64_Codec *codec, const unsigned char *in, size_t len,
+                              unsigned char *out, C64_Decode_State *state, const C64_Lines *lines)
+{
+   // A group of slack for SIMD stores:
+   unsigned char stage[C64_STAGE_SIZE + 16];
+   size_t written = 0;
+
+   for (size_t done = 0; done < len; done += C64_STAGE_SIZE)
+   {
+      size_t block = len - done < C64_STAGE_SIZE ? len - done : C64_STAGE_SIZE;
+
+      prefetch_stream(in + done + block, len - done - block < block ? len - done - block : block);
+      size_t bytes = decode_lines(codec, in + done, block, stage, state, lines);
+      stream_copy(out + written, stage, bytes);
+      written += bytes;
+   }
+
+   return written;
+}
+
+/**
+ * @brief Encode *len* bytes of *input* in *radix* to a string in *buffer*.
+ *
+ * Use **c64_radix_encode_chars_needed** for the size of *buffer*.
+ *
+ * @return Number of characters written, not including the terminating NULL.
+ */
+C64_API size_t c64_radix_encode_to_buffer(C64_Radix radix, const void *input, size_t len,
+                                          char *buffer, size_t bufflen)
+{
+   assert(bufflen >= c64_radix_encode_chars_needed(radix, len));
+
+   const C64_Codec *codec = get_radix_codec(radix);
+   C64_PROBE2(encode_entry, codec->bits, len);
+
+   size_t written = is_large(len)
+      ? encode_large(codec, (const unsigned char*)input, len, buffer)
+      : encode_groups(codec, (const unsigned char*)input, len, buffer);
+   buffer[written] = '\0';
+
+   C64_PROBE2(encode_return, codec->bits, written);
+   return written;
+}
+
+/**
+ * @brief Decode a whole buffer with *codec*, including an incomplete
+ *        final group.
+ *
+ * @return Number of bytes written to *out*.
+ */
+C64_LOCAL size_t decode_buffer(const C64_Codec *codec, const unsigned char *in, size_t len, unsigned char *out)
+{
+   C64_Decode_State state = { 0, 0 };
+   C64_Lines lines;
+
+   C64_PROBE2(decode_entry, codec->bits, len);
+
+   detect_lines(codec, in, len, &lines);
+
+   size_t written = is_large(len)
+      ? decode_large(codec, in, len, out, &state, &lines)
+      : decode_lines(codec, in, len, out, &state, &lines);
+   written += flush_group(codec, &state, out + written);
+
+   C64_PROBE2(decode_return, codec->bits, written);
+   return written;
+}
+
+/**
+ * @brief Decode *len* characters of *radix*-encoded *input* to *buffer*.
+ *
+ * Characters that are neither digits nor padding are skipped.  Use
+ * **c64_radix_decode_chars_needed** for the size of *buffer*.
+ *
+ * @return Number of bytes written to *buffer*.
+ */
+C64_API size_t c64_radix_decode_to_buffer(C64_Radix radix, const char *input, size_t len,
+                                          void *buffer, size_t bufflen)
+{
+   assert(bufflen >= c64_radix_decode_chars_needed(radix, len));
+
+   return decode_buffer(get_radix_codec(radix), (const unsigned char*)input, len, (unsigned char*)buffer);
+}
+
+/**
+ * @brief Encode stream to stream in *radix*.
+ *
+ * @param breaks  Characters per line, 0 for no line breaks.
+ * @param crc     If not NULL, a running CRC32C that is updated with the input.
+ */
+C64_API void c64_radix_encode_stream_to_stream(C64_Radix radix, FILE *in, FILE *out,
+                                               unsigned int breaks, uint32_t *crc)
+{
+   C64_Reader reader = c64_file_reader(in);
+   C64_Writer writer = c64_file_writer(out);
+
+   encode_stream(get_radix_codec(radix), &reader, &writer, breaks, crc);
+}
+
+/**
+ * @brief Decode *radix*-encoded stream to stream.
+ *
+ * @param crc  If not NULL, a running CRC32C that is updated with the output.
+ */
+C64_API void c64_radix_decode_stream_to_stream(C64_Radix radix, FILE *in, FILE *out, uint32_t *crc)
+{
+   C64_Reader reader = c64_file_reader(in);
+   C64_Writer writer = c64_file_writer(out);
+
+   decode_stream(get_radix_codec(radix), &reader, &writer, crc, NULL);
+}
+
+/**
+ * @brief Encode what *in* reads in *radix* and give it to *out*, with
+ *        no stdio in between.
+ *
+ * The reader is asked for blocks of 15 KB, and called again until the
+ * block is full, so it may return less at a time.
+ *
+ * @param breaks  Characters per line, 0 for no line breaks.
+ * @param crc     If not NULL, a running CRC32C that is updated with the input.
+ *
+ * @return 0 on success, or -1 if the reader or writer failed.
+ */
+C64_API int c64_radix_encode_reader_to_writer(C64_Radix radix, C64_Reader in, C64_Writer out,
+                                              unsigned int breaks, uint32_t *crc)
+{
+   return encode_stream(get_radix_codec(radix), &in, &out, breaks, crc);
+}
+
+/**
+ * @brief Decode what *in* reads in *radix* and give it to *out*, with
+ *        no stdio in between.
+ *
+ * @param crc  If not NULL, a running CRC32C that is updated with the output.
+ *
+ * @return 0 on success, or -1 if the reader or writer failed.
+ */
+C64_API int c64_radix_decode_reader_to_writer(C64_Radix radix, C64_Reader in, C64_Writer out, uint32_t *crc)
+{
+   return decode_stream(get_radix_codec(radix), &in, &out, crc, NULL);
+}
+
+/**
+ * Input bytes of the chunks handed between the threads of a pipeline,
+ * large enough to make the hand-offs rare and small enough that a chunk
+ * is still in the cache when the next stage gets to it.
+ */
+#define C64_CHUNK_SIZE (256 * 1024)
+
+/** Chunk buffers per codec thread: one being filled, one being converted, one being written. */
+#define C64_PIPE_SLOTS 3
+
+/** Capacity of a pipeline queue, a power of 2 with room for every slot plus the quit marker. */
+#define C64_RING_SIZE 4
+
+/**
+ * @brief Buffers of one chunk as it moves through a pipeline.
+ *
+ * The reader fills *in*, a codec thread converts it to *out*, and the
+ * writer writes *out* before handing the slot back to the reader.
+ */
+typedef struct _C64_Slot
+{
+   unsigned char *in;
+   unsigned char *out;
+   size_t in_len;
+   size_t out_len;
+   int last;                    // the final chunk of the input
+} C64_Slot;
+
+/**
+ * @brief Lock-free queue between exactly one producer and one consumer.
+ *
+ * Only the producer moves *tail* and only the consumer moves *head*, so
+ * a release store of either index publishes the item it covers.
+ */
+typedef struct _C64_Ring
+{
+   _Atomic size_t head;
+   _Atomic size_t tail;
+   C64_Slot *items[C64_RING_SIZE];
+} C64_Ring;
+
+/**
+ * @brief Wait for the other end of a queue, spinning briefly before
+ *        yielding and finally sleeping so that a stalled stage, like
+ *        a reader waiting on a pipe, does not keep the others busy.
+ */
+C64_LOCAL void ring_wait(unsigned int *spins)
+{
+   ++*spins;
+   if (*spins < 64)
+   {
+#ifdef C64_X86
+      _mm_pause();
+#endif
+   }
+   else if (*spins < 1024)
+      sched_yield();
+   else
+   {
+      struct timespec nap = { 0, 50000 };
+      nanosleep(&nap, NULL);
+   }
+}
+
+C64_LOCAL void ring_push(C64_Ring *ring, C64_Slot *slot)
+{
+   size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+   unsigned int spins = 0;
+
+   while (tail - atomic_load_explicit(&ring->head, memory_order_acquire) == C64_RING_SIZE)
+      ring_wait(&spins);
+
+   ring->items[tail % C64_RING_SIZE] = slot;
+   atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+C64_LOCAL C64_Slot *ring_pop(C64_Ring *ring)
+{
+   size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+   unsigned int spins = 0;
+
+   while (atomic_load_explicit(&ring->tail, memory_order_acquire) == head)
+      ring_wait(&spins);
+
+   C64_Slot *slot = ring->items[head % C64_RING_SIZE];
+   atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+   return slot;
+}
+
+typedef struct _C64_Pipeline C64_Pipeline;
+
+/**
+ * @brief A codec thread and the queues that connect it to the reader and writer.
+ *
+ * Chunks are dealt to the codec threads in turn, and the writer collects
+ * them in the same turn, so the output stays in order without any
+ * sequence numbers.
+ */
+typedef struct _C64_Pipe_Worker
+{
+   C64_Pipeline *pipeline;
+   C64_Ring free;               // writer to reader: empty slots
+   C64_Ring filled;             // reader to codec thread
+   C64_Ring done;               // codec thread to writer
+   C64_Slot slots[C64_PIPE_SLOTS];
+   pthread_t thread;
+} C64_Pipe_Worker;
+
+struct _C64_Pipeline
+{
+   const C64_Codec *codec;
+   FILE *in;
+   FILE *out;
+   int decoding;
+   unsigned int line_chars;
+   size_t chunk_bytes;          // bytes read per chunk
+   size_t out_bytes;            // size of each slot's output buffer
+   uint32_t *crc;
+   unsigned int count;
+   C64_Pipe_Worker *workers;
+   pthread_t reader;
+   uint64_t total_read;         // for the return probes, by the reader
+   uint64_t total_written;      // and by the writer
+   atomic_int failed;           // set by the reader or writer on an I/O error
+};
+
+#ifdef C64_X86
+/** Most runs of consecutive digit characters that **digit_runs** describes. */
+#define C64_MAX_RUNS 8
+
+/**
+ * @brief Describe the digits of *codec* as runs of consecutive
+ *        characters for comparing 16 characters at a time.
+ *
+ * A character is in run *r* if it is greater than *above[r]* and less
+ * than *below[r]* as signed bytes, so characters above 127, which are
+ * never digits, compare as negative and outside of every run.
+ *
+ * @return Number of runs, more than C64_MAX_RUNS if an alphabet's special
+ *         characters are scattered too widely to be described.
+ */
+C64_LOCAL int digit_runs(const C64_Codec *codec, __m128i *above, __m128i *below)
+{
+   const unsigned char *table = codec->table;
+   int runs = 0, c = 0;
+
+   while (c < 128 && runs <= C64_MAX_RUNS)
+   {
+      if (table[c] >= C64_PADDING)
+         ++c;
+      else
+      {
+         int first = c;
+         while (c < 128 && table[c] < C64_PADDING)
+            ++c;
+
+         if (runs < C64_MAX_RUNS)
+         {
+            above[runs] = _mm_set1_epi8(first - 1);
+            below[runs] = _mm_set1_epi8(c);
+         }
+         ++runs;
+      }
+   }
+
+   return runs;
+}
+
+/**
+ * @brief Set the bytes that are 16 *chars* in one of the *runs* to 0xFF.
+ */
+C64_LOCAL __m128i digit_match(__m128i chars, const __m128i *above, const __m128i *below, int runs)
+{
+   __m128i matched = _mm_setzero_si128();
+
+   for (int r = 0; r < runs; ++r)
+      matched = _mm_or_si128(matched, _mm_and_si128(_mm_cmpgt_epi8(chars, above[r]),
+                                                    _mm_cmplt_epi8(chars, below[r])));
+
+   return matched;
+}
+
+/**
+ * @brief Sum of the 16 byte counters of *counts*.
+ *
+ * Digits are counted by subtracting each 0xFF (-1) match from byte
+ * counters, which must be summed before 255 blocks overflow them.
+ */
+C64_LOCAL size_t sum_counts(__m128i counts)
+{
+   __m128i sums = _mm_sad_epu8(counts, _mm_setzero_si128());
+   return _mm_cvtsi128_si32(sums) + _mm_extract_epi16(sums, 4);
+}
+#endif
+
+/**
+ * @brief Count the characters of *in* that are digits of *codec*.
+ *
+ * On x86, the characters are compared 16 at a time with each run of
+ * consecutive digit characters in the decode table.
+ */
+C64_LOCAL size_t count_digits(const C64_Codec *codec, const unsigned char *in, size_t len)
+{
+   const unsigned char *table = codec->table;
+   size_t count = 0, i = 0;
+
+#ifdef C64_X86
+   __m128i above[C64_MAX_RUNS], below[C64_MAX_RUNS];
+   int runs = digit_runs(codec, above, below);
+
+   if (runs <= C64_MAX_RUNS)
+   {
+      __m128i counts = _mm_setzero_si128();
+      unsigned int blocks = 0;
+
+      for (; len - i >= 16; i += 16)
+      {
+         __m128i chars = _mm_loadu_si128((const __m128i*)(in + i));
+         counts = _mm_sub_epi8(counts, digit_match(chars, above, below, runs));
+
+         if (++blocks == 255)
+         {
+            count += sum_counts(counts);
+            counts = _mm_setzero_si128();
+            blocks = 0;
+         }
+      }
+
+      count += sum_counts(counts);
+   }
+#endif
+
+   for (; i < len; ++i)
+      count += table[in[i]] < C64_PADDING;
+
+   return count;
+}
+
+/**
+ * @brief Move the digits of the group that is incomplete at the end of
+ *        a chunk to *carry*, so that every chunk but the last can be
+ *        decoded without the state left by the one before it.
+ *
+ * Padding completes a group wherever it appears, so the digits are
+ * counted from the last padding character.
+ *
+ * @return Number of digits moved to *carry*, which are removed from the
+ *         chunk by shortening *slot->in_len*.
+ */
+C64_LOCAL size_t split_decode_chunk(const C64_Codec *codec, C64_Slot *slot, unsigned char *carry)
+{
+   const unsigned char *table = codec->table;
+   const unsigned char *in = slot->in;
+   size_t len = slot->in_len;
+   size_t start = 0;
+
+   // The reader is a serial stage, so rather than classify every
+   // character for padding, find the last padding character with
+   // memchr and count only the digits after it:
+   const unsigned char *pad = in;
+   while (codec->padding && (pad = memchr(pad, codec->padding, len - (pad - in))))
+      start = ++pad - in;
+
+   size_t left = count_digits(codec, in + start, len - start) % codec->group_chars;
+   size_t moved = left;
+
+   while (left > 0)
+   {
+      --len;
+      if (table[in[len]] < C64_PADDING)
+         carry[--left] = in[len];
+   }
+
+   slot->in_len = len;
+   return moved;
+}
+
+/**
+ * @brief Reader thread: fill chunks and deal them to the codec threads.
+ *
+ * Chunks are filled completely so that only the last one is short,
+ * which keeps encoded lines and groups from straddling chunks even when
+ * the input is a pipe delivering arbitrary amounts at a time.
+ */
+C64_LOCAL void *pipeline_reader(void *arg)
+{
+   C64_Pipeline *pipeline = (C64_Pipeline*)arg;
+   unsigned char carry[8];
+   size_t carried = 0;
+   unsigned int turn = 0;
+   int last = 0;
+
+   while (!last)
+   {
+      C64_Pipe_Worker *worker = &pipeline->workers[turn];
+      C64_Slot *slot = ring_pop(&worker->free);
+
+      // After the writer fails, send an empty last chunk to stop the others:
+      if (atomic_load_explicit(&pipeline->failed, memory_order_relaxed))
+      {
+         slot->in_len = 0;
+         slot->last = last = 1;
+         ring_push(&worker->filled, slot);
+         break;
+      }
+
+      memcpy(slot->in, carry, carried);
+      size_t bytes_read = fread(slot->in + carried, 1, pipeline->chunk_bytes, pipeline->in);
+      C64_PROBE1(block_read, bytes_read);
+      pipeline->total_read += bytes_read;
+
+      slot->in_len = carried + bytes_read;
+      slot->last = last = bytes_read < pipeline->chunk_bytes;
+      carried = 0;
+
+      // A read error ends the input like its end, but fails the conversion:
+      if (last && ferror(pipeline->in))
+         atomic_store_explicit(&pipeline->failed, 1, memory_order_relaxed);
+
+      if (pipeline->decoding)
+      {
+         if (!last)
+            carried = split_decode_chunk(pipeline->codec, slot, carry);
+      }
+      else if (pipeline->crc)
+         *pipeline->crc = c64_crc32c(*pipeline->crc, slot->in, slot->in_len);
+
+      ring_push(&worker->filled, slot);
+      turn = (turn + 1) % pipeline->count;
+   }
+
+   // Signal every codec thread to quit after the chunks it already has:
+   for (unsigned int i = 0; i < pipeline->count; ++i)
+      ring_push(&pipeline->workers[i].filled, NULL);
+
+   return NULL;
+}
+
+/**
+ * @brief Codec thread: convert each chunk independently of the others.
+ */
+C64_LOCAL void *pipeline_worker(void *arg)
+{
+   C64_Pipe_Worker *worker = (C64_Pipe_Worker*)arg;
+   C64_Pipeline *pipeline = worker->pipeline;
+   const C64_Codec *codec = pipeline->codec;
+   C64_Slot *slot;
+
+   while ((slot = ring_pop(&worker->filled)))
+   {
+      if (pipeline->decoding)
+      {
+         C64_Decode_State state = { 0, 0 };
+         C64_Lines lines;
+
+         detect_lines(codec, slot->in, slot->in_len, &lines);
+         slot->out_len = decode_lines(codec, slot->in, slot->in_len, slot->out, &state, &lines);
+         // Only the last chunk can end with an incomplete group:
+         slot->out_len += flush_group(codec, &state, slot->out + slot->out_len);
+      }
+      else
+      {
+         // Every chunk starts a new line:
+         unsigned int column = 0;
+         slot->out_len = encode_lines(codec, slot->in, slot->in_len, (char*)slot->out,
+                                      pipeline->line_chars, &column);
+      }
+
+      ring_push(&worker->done, slot);
+   }
+
+   return NULL;
+}
+
+/**
+ * @brief Writer, run on the calling thread: write the chunks in the
+ *        order they were read.
+ */
+C64_LOCAL void pipeline_writer(C64_Pipeline *pipeline)
+{
+   unsigned int turn = 0;
+   int last = 0;
+
+   while (!last)
+   {
+      C64_Pipe_Worker *worker = &pipeline->workers[turn];
+      C64_Slot *slot = ring_pop(&worker->done);
+
+      if (pipeline->decoding && pipeline->crc)
+         *pipeline->crc = c64_crc32c(*pipeline->crc, slot->out, slot->out_len);
+
+      // Once a write fails, the rest is drained without being written:
+      if (!atomic_load_explicit(&pipeline->failed, memory_order_relaxed))
+      {
+         if (fwrite(slot->out, 1, slot->out_len, pipeline->out) != slot->out_len)
+            atomic_store_explicit(&pipeline->failed, 1, memory_order_relaxed);
+         C64_PROBE1(block_write, slot->out_len);
+         pipeline->total_written += slot->out_len;
+      }
+
+      last = slot->last;
+      ring_push(&worker->free, slot);
+      turn = (turn + 1) % pipeline->count;
+   }
+
+   // A full disk may only show when the buffered output is written:
+   if (fflush(pipeline->out))
+      atomic_store_explicit(&pipeline->failed, 1, memory_order_relaxed);
+}
+
+/**
+ * @brief Release the buffers and workers of a pipeline.
+ */
+C64_LOCAL void free_pipeline(C64_Pipeline *pipeline)
+{
+   for (unsigned int i = 0; i < pipeline->count; ++i)
+      for (unsigned int s = 0; s < C64_PIPE_SLOTS; ++s)
+      {
+         free(pipeline->workers[i].slots[s].in);
+         free(pipeline->workers[i].slots[s].out);
+      }
+
+   free(pipeline->workers);
+}
+
+/**
+ * @brief Run a stream conversion as a reader thread, *threads* codec
+ *        threads, and a writer on the calling thread.
+ *
+ * @return 0 on success, -1 if the buffers or threads could not be
+ *         created, in which case nothing has been read or written, or
+ *         if reading or writing failed.
+ */
+C64_LOCAL int run_pipeline(C64_Pipeline *pipeline, unsigned int threads)
+{
+   const C64_Codec *codec = pipeline->codec;
+   unsigned int started = 0;
+   int result = 0;
+
+   if (!threads)
+   {
+      long cores = sysconf(_SC_NPROCESSORS_ONLN);
+      threads = cores > 3 ? cores - 2 : 1;
+   }
+
+   if (pipeline->decoding)
+   {
+      pipeline->chunk_bytes = C64_CHUNK_SIZE;
+      // Room for the carried digits, and for the flushed group and SIMD stores:
+      pipeline->out_bytes = C64_CHUNK_SIZE + 32;
+   }
+   else
+   {
+      // Whole lines per chunk, or whole groups without line breaks:
+      size_t unit = codec->group_bytes;
+      if (pipeline->line_chars)
+         unit = pipeline->line_chars / codec->group_chars * codec->group_bytes;
+
+      pipeline->chunk_bytes = C64_CHUNK_SIZE / unit * unit;
+      if (!pipeline->chunk_bytes)
+         pipeline->chunk_bytes = unit;
+
+      size_t chars = pipeline->chunk_bytes / codec->group_bytes * codec->group_chars;
+      pipeline->out_bytes = chars + 32;
+      if (pipeline->line_chars)
+         pipeline->out_bytes += chars / pipeline->line_chars * 2;
+   }
+
+   pipeline->count = threads;
+   pipeline->workers = (C64_Pipe_Worker*)calloc(threads, sizeof(C64_Pipe_Worker));
+   if (!pipeline->workers)
+      return -1;
+
+   for (unsigned int i = 0; i < threads; ++i)
+   {
+      C64_Pipe_Worker *worker = &pipeline->workers[i];
+      worker->pipeline = pipeline;
+
+      for (unsigned int s = 0; s < C64_PIPE_SLOTS; ++s)
+      {
+         C64_Slot *slot = &worker->slots[s];
+         slot->in = (unsigned char*)malloc(pipeline->chunk_bytes + 8);
+         slot->out = (unsigned char*)malloc(pipeline->out_bytes);
+         if (!slot->in || !slot->out)
+            result = -1;
+
+         ring_push(&worker->free, slot);
+      }
+   }
+
+   for (; result == 0 && started < threads; ++started)
+      if (pthread_create(&pipeline->workers[started].thread, NULL,
+                         pipeline_worker, &pipeline->workers[started]))
+         result = -1;
+
+   if (result == 0 && pthread_create(&pipeline->reader, NULL, pipeline_reader, pipeline))
+      result = -1;
+
+   if (result == 0)
+   {
+      pipeline_writer(pipeline);
+      pthread_join(pipeline->reader, NULL);
+
+      if (atomic_load(&pipeline->failed))
+         result = -1;
+   }
+   else
+   {
+      // Nothing was read: release the codec threads that did start.
+      for (unsigned int i = 0; i < started; ++i)
+         ring_push(&pipeline->workers[i].filled, NULL);
+   }
+
+   for (unsigned int i = 0; i < started; ++i)
+      pthread_join(pipeline->workers[i].thread, NULL);
+
+   free_pipeline(pipeline);
+   return result;
+}
+
+/**
+ * @brief Encode stream to stream in *radix* with the reading, encoding
+ *        and writing in separate threads.
+ *
+ * The stages overlap, so the conversion runs at the speed of the slowest
+ * of them rather than of all of them in turn.  The input is read in
+ * order and may be a pipe.  The output is identical to that of
+ * **c64_radix_encode_stream_to_stream**.
+ *
+ * @param breaks   Characters per line, 0 for no line breaks.
+ * @param threads  Encoding threads, 0 for two fewer than the number of
+ *                 processors (at least one).
+ * @param crc      If not NULL, a running CRC32C that is updated with the input.
+ *
+ * @return 0 on success, -1 if the threads could not be started, in
+ *         which case the streams have not been touched, or if reading
+ *         or writing failed, in which case **ferror** is set on the
+ *         stream that failed.
+ */
+C64_API int c64_encode_stream_to_stream_pipelined(C64_Radix radix, FILE *in, FILE *out,
+                                                  unsigned int breaks, unsigned int threads,
+                                                  uint32_t *crc)
+{
+   C64_Pipeline pipeline;
+   memset(&pipeline, 0, sizeof(pipeline));
+
+   pipeline.codec = get_radix_codec(radix);
+   pipeline.in = in;
+   pipeline.out = out;
+   pipeline.line_chars = line_chars_from_breaks(breaks, pipeline.codec->group_chars);
+   pipeline.crc = crc;
+
+   C64_PROBE1(stream_encode_entry, pipeline.codec->bits);
+   int result = run_pipeline(&pipeline, threads);
+   C64_PROBE3(stream_encode_return, pipeline.codec->bits, pipeline.total_read, pipeline.total_written);
+
+   return result;
+}
+
+/**
+ * @brief Decode *radix*-encoded stream to stream with the reading,
+ *        decoding and writing in separate threads.
+ *
+ * @param threads  Decoding threads, 0 for two fewer than the number of
+ *                 processors (at least one).
+ * @param crc      If not NULL, a running CRC32C that is updated with the output.
+ *
+ * @return 0 on success, -1 if the threads could not be started, in
+ *         which case the streams have not been touched, or if reading
+ *         or writing failed, in which case **ferror** is set on the
+ *         stream that failed.
+ */
+C64_API int c64_decode_stream_to_stream_pipelined(C64_Radix radix, FILE *in, FILE *out,
+                                                  unsigned int threads, uint32_t *crc)
+{
+   C64_Pipeline pipeline;
+   memset(&pipeline, 0, sizeof(pipeline));
+
+   pipeline.codec = get_radix_codec(radix);
+   pipeline.in = in;
+   pipeline.out = out;
+   pipeline.decoding = 1;
+   pipeline.crc = crc;
+
+   C64_PROBE1(stream_decode_entry, pipeline.codec->bits);
+   int result = run_pipeline(&pipeline, threads);
+   C64_PROBE3(stream_decode_return, pipeline.codec->bits, pipeline.total_read, pipeline.total_written);
+
+   return result;
+}
+
+/**
+ * @brief Progress of validating encoded input, carried between blocks.
+ */
+typedef struct _C64_Check_State
+{
+   uint64_t digits;             // digits so far
+   unsigned int pads;           // padding characters of the final group so far
+   uint64_t offset;             // characters checked before the current block
+   uint64_t error_offset;       // offset of the first offending character
+} C64_Check_State;
+
+/**
+ * @brief Returns 1 if a final group of *count* digits holds a whole
+ *        number of bytes, that is, if its last digit is needed.
+ *
+ * A single base64 digit, or 1, 3 or 6 base32 digits, cannot end the input.
+ */
+C64_LOCAL int valid_group_end(const C64_Codec *codec, unsigned int count)
+{
+   return count * codec->bits / 8 > (count - 1) * codec->bits / 8;
+}
+
+C64_LOCAL int is_check_space(unsigned char c)
+{
+   return c == '\n' || c == '\r' || c == ' ' || c == '\t';
+}
+
+/**
+ * @brief Validate a block of encoded characters.
+ *
+ * Digits and the whitespace of line breaks may appear anywhere before
+ * the padding, which must complete the final group, and after which
+ * only whitespace may follow.  On x86, runs of 16 characters that are
+ * all digits or whitespace are only counted, without going through
+ * the rules a character at a time.
+ *
+ * @return 1 if the block is valid so far, otherwise 0 with
+ *         *state->error_offset* set.
+ */
+C64_LOCAL int check_block(const C64_Codec *codec, const unsigned char *in, size_t len, C64_Check_State *state)
+{
+   const unsigned char *table = codec->table;
+   size_t i = 0;
+
+#ifdef C64_X86
+   __m128i above[C64_MAX_RUNS], below[C64_MAX_RUNS];
+   int runs = digit_runs(codec, above, below);
+#endif
+
+   while (i < len)
+   {
+#ifdef C64_X86
+      if (!state->pads && runs <= C64_MAX_RUNS)
+      {
+         __m128i counts = _mm_setzero_si128();
+         unsigned int blocks = 0;
+
+         for (; len - i >= 16; i += 16)
+         {
+            __m128i chars = _mm_loadu_si128((const __m128i*)(in + i));
+            __m128i space = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8('\n')),
+                                                      _mm_cmpeq_epi8(chars, _mm_set1_epi8('\r'))),
+                                         _mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8(' ')),
+                                                      _mm_cmpeq_epi8(chars, _mm_set1_epi8('\t'))));
+            __m128i is_digit = digit_match(chars, above, below, runs);
+
+            if (_mm_movemask_epi8(_mm_or_si128(is_digit, space)) != 0xFFFF)
+               break;
+
+            counts = _mm_sub_epi8(counts, is_digit);
+            if (++blocks == 255)
+            {
+               state->digits += sum_counts(counts);
+               counts = _mm_setzero_si128();
+               blocks = 0;
+            }
+         }
+
+         state->digits += sum_counts(counts);
+
+         if (i == len)
+            break;
+      }
+#endif
+
+      unsigned char c = in[i];
+      unsigned char val = table[c];
+      unsigned int count = state->digits % codec->group_chars;
+
+      if (val < C64_PADDING)
+      {
+         if (state->pads)
+            break;
+         ++state->digits;
+      }
+      else if (val == C64_PADDING)
+      {
+         if (count == 0 || !valid_group_end(codec, count) || count + ++state->pads > codec->group_chars)
+            break;
+      }
+      else if (!is_check_space(c))
+         break;
+
+      ++i;
+   }
+
+   if (i < len)
+   {
+      state->error_offset = state->offset + i;
+      return 0;
+   }
+
+   state->offset += len;
+   return 1;
+}
+
+/**
+ * @brief Check the end of the input after its last block.
+ *
+ * @return 1 if valid, with the exact decoded length in *decoded_length*.
+ */
+C64_LOCAL int finish_check(const C64_Codec *codec, C64_Check_State *state, uint64_t *decoded_length)
+{
+   unsigned int count = state->digits % codec->group_chars;
+
+   // Padding must fill the final group, but it may also be omitted:
+   if ((state->pads && count + state->pads != codec->group_chars)
+       || (count && !valid_group_end(codec, count)))
+   {
+      state->error_offset = state->offset;
+      return 0;
+   }
+
+   *decoded_length = state->digits / codec->group_chars * codec->group_bytes + count * codec->bits / 8;
+   return 1;
+}
+
+/**
+ * @brief Validate *len* characters of *radix*-encoded *input* without
+ *        decoding them, and find the exact length of the decoding.
+ *
+ * The input may contain line breaks and other whitespace between
+ * digits.  The padding may be omitted, but if present, it must complete
+ * the final group and may only be followed by whitespace.  Any other
+ * character makes the input invalid.  Unlike **c64_decode_chars_needed**,
+ * the length is exact, not counting whitespace or padding.
+ *
+ * @param decoded_length  If not NULL, set to the number of bytes the
+ *                        input decodes to if it is valid.
+ * @param error_offset    If not NULL, set to the offset of the first
+ *                        invalid character if it is not.  The offset
+ *                        is *len* if the input ends too early.
+ *
+ * @return 1 if the input is valid, otherwise 0.
+ */
+C64_API int c64_radix_check_buffer(C64_Radix radix, const char *input, size_t len,
+                                   size_t *decoded_length, size_t *error_offset)
+{
+   const C64_Codec *codec = get_radix_codec(radix);
+   C64_Check_State state = { 0, 0, 0, 0 };
+   uint64_t length;
+
+   if (check_block(codec, (const unsigned char*)input, len, &state)
+       && finish_check(codec, &state, &length))
+   {
+      if (decoded_length)
+         *decoded_length = length;
+      return 1;
+   }
+
+   if (error_offset)
+      *error_offset = state.error_offset;
+   return 0;
+}
+
+/**
+ * @brief Validate a *radix*-encoded stream, as **c64_radix_check_buffer**
+ *        does a buffer, reading it until the end or the first error.
+ *
+ * A read error makes the input invalid, with *error_offset* where
+ * reading stopped.
+ */
+C64_API int c64_radix_check_stream(C64_Radix radix, FILE *in,
+                                   uint64_t *decoded_length, uint64_t *error_offset)
+{
+   const C64_Codec *codec = get_radix_codec(radix);
+   C64_Check_State state = { 0, 0, 0, 0 };
+   unsigned char inbuff[C64_BLOCK_SIZE];
+   size_t bytes_read;
+   uint64_t length;
+   int valid = 1;
+
+   while (valid && (bytes_read = fread(inbuff, 1, sizeof(inbuff), in)) > 0)
+      valid = check_block(codec, inbuff, bytes_read, &state);
+
+   if (valid && ferror(in))
+   {
+      state.error_offset = state.offset;
+      valid = 0;
+   }
+
+   if (valid && finish_check(codec, &state, &length))
+   {
+      if (decoded_length)
+         *decoded_length = length;
+      return 1;
+   }
+
+   if (error_offset)
+      *error_offset = state.error_offset;
+   return 0;
+}
+
+/** Most of the input scanned for special characters before choosing among candidates. */
+#define C64_DETECT_PREFIX C64_BLOCK_SIZE
+
+/** Most candidate sets of special characters that auto-detection compares. */
+#define C64_MAX_CANDIDATES 32
+
+/** Candidates when the caller gives none: standard and URL-safe base64. */
+static const char *const default_candidates[] = { "+/=", "-_" };
+
+/**
+ * @brief What auto-detection has seen of the special characters of the
+ *        input, and how well each candidate explains them.
+ */
+typedef struct _C64_Scores
+{
+   uint32_t as_digit[256];      // candidates using each character for 62 or 63
+   uint32_t as_padding[256];    // and for padding
+   unsigned char seen[256];
+   unsigned int score[C64_MAX_CANDIDATES];
+   unsigned int count;
+   unsigned int best;
+} C64_Scores;
+
+/**
+ * @brief Credit every candidate that uses *c*, the first time it is seen.
+ *
+ * A digit counts twice as much as padding, which can only appear at
+ * the end.  Of candidates with equal scores, the first is best.
+ */
+C64_LOCAL void score_special(C64_Scores *scores, unsigned char c)
+{
+   if (scores->seen[c])
+      return;
+   scores->seen[c] = 1;
+
+   for (unsigned int i = 0; i < scores->count; ++i)
+   {
+      scores->score[i] += (scores->as_digit[c] >> i & 1) * 2 + (scores->as_padding[c] >> i & 1);
+
+      if (scores->score[i] > scores->score[scores->best]
+          || (scores->score[i] == scores->score[scores->best] && i < scores->best))
+         scores->best = i;
+   }
+}
+
+/**
+ * @brief Choose the set of special characters of base64 input.
+ *
+ * The input is scanned until some candidate's characters for both 62
+ * and 63 have been seen, which takes a few dozen characters of most
+ * data.  On x86, 16 characters are compared at a time, and only those
+ * that are neither letters, decimal digits nor line ends are looked
+ * at.  Characters that no candidate uses are ignored, as decoding
+ * skips them.
+ *
+ * @param candidates  Strings of 2 or 3 special characters, as for
+ *                    **c64_set_special_chars**, or NULL for "+/=" and "-_".
+ * @param count       Number of candidates, at most 32.
+ *
+ * @return Index of the candidate whose characters best explain those
+ *         of the input, or 0 if it has none of them.
+ */
+C64_API int c64_detect_special_chars(const char *input, size_t len,
+                                     const char *const *candidates, unsigned int count)
+{
+   const unsigned char *in = (const unsigned char*)input;
+   C64_Scores scores;
+   size_t i = 0;
+
+   if (!candidates)
+   {
+      candidates = default_candidates;
+      count = sizeof(default_candidates) / sizeof(default_candidates[0]);
+   }
+
+   memset(&scores, 0, sizeof(scores));
+   scores.count = count < C64_MAX_CANDIDATES ? count : C64_MAX_CANDIDATES;
+
+   for (unsigned int c = 0; c < scores.count; ++c)
+   {
+      const unsigned char *specials = (const unsigned char*)candidates[c];
+      assert(specials[0] && specials[1]);
+
+      scores.as_digit[specials[0]] |= 1u << c;
+      scores.as_digit[specials[1]] |= 1u << c;
+      if (specials[2])
+         scores.as_padding[specials[2]] |= 1u << c;
+   }
+
+#ifdef C64_X86
+   const __m128i above[3] = { _mm_set1_epi8('A' - 1), _mm_set1_epi8('a' - 1), _mm_set1_epi8('0' - 1) };
+   const __m128i below[3] = { _mm_set1_epi8('Z' + 1), _mm_set1_epi8('z' + 1), _mm_set1_epi8('9' + 1) };
+   const __m128i newline = _mm_set1_epi8('\n');
+   const __m128i ret = _mm_set1_epi8('\r');
+
+   // Both digits of the best candidate score 4:
+   for (; len - i >= 16 && scores.score[scores.best] < 4; i += 16)
+   {
+      __m128i chars = _mm_loadu_si128((const __m128i*)(in + i));
+      __m128i plain = _mm_or_si128(digit_match(chars, above, below, 3),
+                                   _mm_or_si128(_mm_cmpeq_epi8(chars, newline), _mm_cmpeq_epi8(chars, ret)));
+      unsigned int others = ~_mm_movemask_epi8(plain) & 0xFFFF;
+
+      for (; others; others &= others - 1)
+         score_special(&scores, in[i + __builtin_ctz(others)]);
+   }
+#endif
+
+   for (; i < len && scores.score[scores.best] < 4; ++i)
+      if (!isalnum(in[i]))
+         score_special(&scores, in[i]);
+
+   return scores.best;
+}
+
+/**
+ * @brief Choose the special characters by a prefix of *in*, and build
+ *        the base64 codec of the chosen ones in *detect*.
+ *
+ * Each conversion gets its own codec, so the special characters of
+ * **c64_set_special_chars** and other threads are left alone.
+ */
+C64_LOCAL const C64_Codec *detect_codec(C64_Detect *detect, const unsigned char *in, size_t len)
+{
+   detect->chosen = c64_detect_special_chars((const char*)in, len < C64_DETECT_PREFIX ? len : C64_DETECT_PREFIX,
+                                             detect->candidates, detect->count);
+
+   const char *specials = detect->candidates[detect->chosen];
+
+   memcpy(detect->alphabet, digits, 62);
+   detect->alphabet[62] = specials[0];
+   detect->alphabet[63] = specials[1];
+   detect->alphabet[64] = '\0';
+
+   // The bulk functions are chosen by build_codec:
+   C64_Codec *codec = &detect->codec;
+   memset(codec, 0, sizeof(*codec));
+   codec->bits = 6;
+   codec->group_bytes = 3;
+   codec->group_chars = 4;
+   codec->alphabet = detect->alphabet;
+   codec->padding = specials[2];
+   build_codec(codec);
+
+   return codec;
+}
+
+C64_LOCAL void init_detect(C64_Detect *detect, const char *const *candidates, unsigned int count)
+{
+   if (!candidates)
+   {
+      candidates = default_candidates;
+      count = sizeof(default_candidates) / sizeof(default_candidates[0]);
+   }
+
+   detect->candidates = candidates;
+   detect->count = count < C64_MAX_CANDIDATES ? count : C64_MAX_CANDIDATES;
+   detect->chosen = 0;
+}
+
+/**
+ * @brief Decode base64 *input* of any of several sets of special
+ *        characters, choosing the set by the characters of the input.
+ *
+ * The set is chosen by **c64_detect_special_chars** from at most the
+ * first 15 KB, and the input is then decoded with it in the usual way.
+ * Use **c64_radix_decode_chars_needed** for the size of *buffer*.
+ *
+ * @param candidates  Strings of 2 or 3 special characters, or NULL for
+ *                    "+/=" and "-_".
+ * @param detected    If not NULL, set to the index of the candidate used.
+ *
+ * @return Number of bytes written to *buffer*.
+ */
+C64_API size_t c64_decode_detected_to_buffer(const char *input, size_t len, void *buffer, size_t bufflen,
+                                             const char *const *candidates, unsigned int count, int *detected)
+{
+   assert(bufflen >= c64_radix_decode_chars_needed(C64_BASE64, len));
+
+   C64_Detect detect;
+   init_detect(&detect, candidates, count);
+
+   const C64_Codec *codec = detect_codec(&detect, (const unsigned char*)input, len);
+   size_t written = decode_buffer(codec, (const unsigned char*)input, len, (unsigned char*)buffer);
+
+   if (detected)
+      *detected = detect.chosen;
+   return written;
+}
+
+/**
+ * @brief Decode what *in* reads, choosing the special characters by
+ *        the first block, as **c64_decode_detected_to_buffer** does.
+ *
+ * @param crc  If not NULL, a running CRC32C that is updated with the output.
+ *
+ * @return 0 on success, or -1 if the reader or writer failed.
+ */
+C64_API int c64_decode_detected_reader_to_writer(C64_Reader in, C64_Writer out,
+                                                 const char *const *candidates, unsigned int count,
+                                                 int *detected, uint32_t *crc)
+{
+   C64_Detect detect;
+   init_detect(&detect, candidates, count);
+
+   int result = decode_stream(prepare_codec(&base64_codec), &in, &out, crc, &detect);
+
+   if (detected)
+      *detected = detect.chosen;
+   return result;
+}
+
+#ifndef C64_NO_ZLIB
+/**
+ * @brief Encode the complete groups of the **available* compressed
+ *        bytes in *zbuff*, or all of them at the end of the stream, and
+ *        move the rest to the front to wait for more.
+ *
+ * **available* is set to the number of compressed bytes left in *zbuff*.
+ *
+ * @return 0, or -1 if *out* did not take all of the encoded data.
+ */
+C64_LOCAL int encode_compressed(const C64_Codec *codec, unsigned char *zbuff, size_t *available, int finished,
+                                char *outbuff, unsigned int line_chars, unsigned int *column, FILE *out)
+{
+   size_t ready = finished ? *available : *available / codec->group_bytes * codec->group_bytes;
+   size_t encoded = encode_lines(codec, zbuff, ready, outbuff, line_chars, column);
+
+   if (fwrite(outbuff, 1, encoded, out) != encoded)
+      return -1;
+   C64_PROBE1(block_write, encoded);
+
+   memmove(zbuff, zbuff + ready, *available - ready);
+   *available -= ready;
+   return 0;
+}
+
+/**
+ * @brief Inflate a block of decoded bytes and write the result.
+ *
+ * Concatenated gzip members are inflated in turn, as gunzip does.
+ * *ended* is set when the data fed so far ends with a complete member.
+ *
+ * @return 0, or -1 if the compressed data is invalid or *out* did not
+ *         take all of the inflated data.
+ */
+C64_LOCAL int inflate_block(z_stream *zs, unsigned char *in, size_t len, unsigned char *outbuff, size_t outlen,
+                            FILE *out, uint32_t *crc, int *ended)
+{
+   int status;
+
+   zs->next_in = in;
+   zs->avail_in = len;
+
+   do
+   {
+      if (zs->avail_in > 0)
+         *ended = 0;
+
+      zs->next_out = outbuff;
+      zs->avail_out = outlen;
+      status = inflate(zs, Z_NO_FLUSH);
+
+      if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR)
+         return -1;
+
+      size_t produced = outlen - zs->avail_out;
+      if (crc)
+         *crc = c64_crc32c(*crc, outbuff, produced);
+      if (fwrite(outbuff, 1, produced, out) != produced)
+         return -1;
+      C64_PROBE1(block_write, produced);
+
+      if (status == Z_STREAM_END)
+      {
+         *ended = 1;
+         inflateReset(zs);
+      }
+   } while (status != Z_BUF_ERROR && (zs->avail_in > 0 || zs->avail_out == 0));
+
+   return 0;
+}
+#endif
+
+/**
+ * @brief Compress a stream with gzip and encode the compressed data in
+ *        *radix*, in one pass.
+ *
+ * The data moves from stage to stage through buffers in this process,
+ * rather than through a pipe from a separate gzip process.  The output
+ * is interchangeable with that of "gzip -c | base64": it decodes to
+ * gzip data that gunzip accepts.
+ *
+ * @param breaks  Characters per line, 0 for no line breaks.
+ * @param level   zlib compression level, 0 to 9, or -1 for the default.
+ * @param crc     If not NULL, a running CRC32C that is updated with the
+ *                uncompressed input.
+ *
+ * @return 0 on success, -1 if the input could not be read, the output
+ *         could not be written or zlib failed, -2 if the library was
+ *         built without zlib.
+ */
+C64_API int c64_encode_stream_to_stream_deflate(C64_Radix radix, FILE *in, FILE *out,
+                                                unsigned int breaks, int level, uint32_t *crc)
+{
+#ifdef C64_NO_ZLIB
+   return -2;
+#else
+   const C64_Codec *codec = get_radix_codec(radix);
+   unsigned int line_chars = line_chars_from_breaks(breaks, codec->group_chars);
+   unsigned int column = 0;
+
+   unsigned char inbuff[C64_BLOCK_SIZE];
+   // Compressed bytes, after any left over from the previous block:
+   unsigned char zbuff[C64_BLOCK_SIZE + 8];
+   // Room for base16 with a line break after every 2 characters:
+   char outbuff[sizeof(zbuff) * 4];
+
+   size_t pending = 0, bytes_read;
+   int flush, status, result = 0;
+   z_stream zs;
+
+   memset(&zs, 0, sizeof(zs));
+   // 16 added to the window bits selects the gzip format:
+   if (deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+      return -1;
+
+   do
+   {
+      bytes_read = fread(inbuff, 1, sizeof(inbuff), in);
+      C64_PROBE1(block_read, bytes_read);
+      flush = bytes_read < sizeof(inbuff) ? Z_FINISH : Z_NO_FLUSH;
+
+      if (crc)
+         *crc = c64_crc32c(*crc, inbuff, bytes_read);
+
+      zs.next_in = inbuff;
+      zs.avail_in = bytes_read;
+
+      do
+      {
+         zs.next_out = zbuff + pending;
+         zs.avail_out = sizeof(zbuff) - pending;
+         status = deflate(&zs, flush);
+
+         pending = sizeof(zbuff) - zs.avail_out;
+         result = encode_compressed(codec, zbuff, &pending, status == Z_STREAM_END,
+                                    outbuff, line_chars, &column, out);
+      } while (result == 0 && zs.avail_out == 0);
+   } while (result == 0 && flush != Z_FINISH);
+
+   deflateEnd(&zs);
+
+   // A full disk may only show when the buffered output is written:
+   if (result == 0 && fflush(out))
+      result = -1;
+
+   return result == 0 && status == Z_STREAM_END && !ferror(in) && !ferror(out) ? 0 : -1;
+#endif
+}
+
+/**
+ * @brief Decode a *radix*-encoded stream and decompress the decoded
+ *        gzip or zlib data, in one pass.
+ *
+ * @param crc  If not NULL, a running CRC32C that is updated with the
+ *             decompressed output.
+ *
+ * @return 0 on success, -1 if the decoded data is not valid compressed
+ *         data or ends early, or if the input could not be read or the
+ *         output written, -2 if the library was built without zlib.
+ */
+C64_API int c64_decode_stream_to_stream_inflate(C64_Radix radix, FILE *in, FILE *out, uint32_t *crc)
+{
+#ifdef C64_NO_ZLIB
+   return -2;
+#else
+   const C64_Codec *codec = get_radix_codec(radix);
+   unsigned char inbuff[C64_BLOCK_SIZE];
+   // Decoded bytes, with a group of slack for flushing and for SIMD stores:
+   unsigned char zbuff[C64_BLOCK_SIZE + 16];
+   unsigned char outbuff[C64_BLOCK_SIZE * 4];
+
+   C64_Decode_State state = { 0, 0 };
+   C64_Lines lines = { 0, 0 };
+   size_t bytes_read, bytes_decoded;
+   int first_block = 1, last_block = 0, ended = 0, result = 0;
+   z_stream zs;
+
+   memset(&zs, 0, sizeof(zs));
+   // 32 added to the window bits accepts either gzip or zlib headers:
+   if (inflateInit2(&zs, 15 + 32) != Z_OK)
+      return -1;
+
+   while (!last_block && result == 0)
+   {
+      bytes_read = fread(inbuff, 1, sizeof(inbuff), in);
+      C64_PROBE1(block_read, bytes_read);
+      last_block = bytes_read < sizeof(inbuff);
+
+      if (first_block)
+      {
+         detect_lines(codec, inbuff, bytes_read, &lines);
+         first_block = 0;
+      }
+
+      bytes_decoded = decode_lines(codec, inbuff, bytes_read, zbuff, &state, &lines);
+
+      // Unpadded input may end with an incomplete group:
+      if (last_block)
+         bytes_decoded += flush_group(codec, &state, zbuff + bytes_decoded);
+
+      result = inflate_block(&zs, zbuff, bytes_decoded, outbuff, sizeof(outbuff), out, crc, &ended);
+   }
+
+   inflateEnd(&zs);
+
+   if (result == 0 && fflush(out))
+      result = -1;
+
+   return result == 0 && ended && !ferror(in) && !ferror(out) ? 0 : -1;
+#endif
+}
+
+/** Values in **C64_Transcoder.map** for characters that are not digits. */
+#define C64_MAP_PADDING 0x100
+#define C64_MAP_SKIP    0x200
+
+/**
+ * @brief Conversion state for translating encoded text from one set of
+ *        special characters to another.
+ *
+ * The 6-bit values are never recomputed: digits 0 through 61 are the
+ * same in every alphabet, so only the characters for 62 and 63 and the
+ * padding change.
+ */
+typedef struct _C64_Transcoder
+{
+   short map[256];           // target char, C64_MAP_PADDING or C64_MAP_SKIP
+   char from62, from63;
+   char to62, to63;
+   char to_padding;          // '\0' to omit padding
+   unsigned int line_chars;  // 0 for no line breaks
+   unsigned int column;      // characters written to the current line
+   unsigned int count;       // digits written in the current group
+} C64_Transcoder;
+
+C64_LOCAL void init_transcoder(C64_Transcoder *tc,
+                               const char *from_specials,
+                               const char *to_specials,
+                               unsigned int breaks)
+{
+   assert(strlen(from_specials) > 1);
+   assert(strlen(to_specials) > 1);
+
+   for (int i=0; i < 256; ++i)
+      tc->map[i] = C64_MAP_SKIP;
+
+   for (int i=0; i < 62; ++i)
+      tc->map[(unsigned char)digits[i]] = digits[i];
+
+   tc->from62 = from_specials[0];
+   tc->from63 = from_specials[1];
+   tc->to62 = to_specials[0];
+   tc->to63 = to_specials[1];
+   tc->to_padding = to_specials[2];
+
+   tc->map[(unsigned char)tc->from62] = tc->to62;
+   tc->map[(unsigned char)tc->from63] = tc->to63;
+   if (from_specials[2])
+      tc->map[(unsigned char)from_specials[2]] = C64_MAP_PADDING;
+
+   tc->line_chars = line_chars_from_breaks(breaks, 4);
+   tc->column = 0;
+   tc->count = 0;
+}
+
+C64_LOCAL char *transcode_put(C64_Transcoder *tc, char *ptr, char chr)
+{
+   *ptr++ = chr;
+   if (tc->line_chars && ++tc->column == tc->line_chars)
+   {
+      *ptr++ = '\r';
+      *ptr++ = '\n';
+      tc->column = 0;
+   }
+   return ptr;
+}
+
+/**
+ * @brief Finish an incomplete group with the target padding character,
+ *        if the target uses padding.
+ */
+C64_LOCAL char *transcode_pad(C64_Transcoder *tc, char *ptr)
+{
+   if (tc->count % 4 && tc->to_padding)
+   {
+      while (tc->count % 4)
+      {
+         ptr = transcode_put(tc, ptr, tc->to_padding);
+         ++tc->count;
+      }
+   }
+   tc->count = 0;
+   return ptr;
+}
+
+#ifdef C64_X86
+/**
+ * @brief Translate 16 characters if all are digits of the source alphabet.
+ *
+ * Letters, decimal digits and the two source special characters are
+ * copied, with the special characters replaced by the target's.
+ *
+ * @return 1 if the 16 characters were written to *out*, 0 if any
+ *         character needs the per-character path.
+ */
+C64_LOCAL int transcode_16(const C64_Transcoder *tc, const unsigned char *in, char *out)
+{
+   __m128i chars = _mm_loadu_si128((const __m128i*)in);
+
+   __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('A' - 1)),
+                                 _mm_cmplt_epi8(chars, _mm_set1_epi8('Z' + 1)));
+   __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('a' - 1)),
+                                 _mm_cmplt_epi8(chars, _mm_set1_epi8('z' + 1)));
+   __m128i decimal = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('0' - 1)),
+                                   _mm_cmplt_epi8(chars, _mm_set1_epi8('9' + 1)));
+   __m128i is62 = _mm_cmpeq_epi8(chars, _mm_set1_epi8(tc->from62));
+   __m128i is63 = _mm_cmpeq_epi8(chars, _mm_set1_epi8(tc->from63));
+
+   __m128i valid = _mm_or_si128(_mm_or_si128(upper, lower),
+                                _mm_or_si128(decimal, _mm_or_si128(is62, is63)));
+   if (_mm_movemask_epi8(valid) != 0xFFFF)
+      return 0;
+
+   // Clear the special characters, then OR in their replacements:
+   __m128i specials = _mm_or_si128(is62, is63);
+   __m128i result = _mm_or_si128(_mm_andnot_si128(specials, chars),
+                                 _mm_or_si128(_mm_and_si128(is62, _mm_set1_epi8(tc->to62)),
+                                              _mm_and_si128(is63, _mm_set1_epi8(tc->to63))));
+   _mm_storeu_si128((__m128i*)out, result);
+   return 1;
+}
+#endif
+
+/**
+ * @brief Translate a block of encoded characters.
+ *
+ * Characters that are neither digits nor padding are dropped, and
+ * line breaks are inserted for the target line length.  Runs of 16
+ * digits that fit on the current line are translated with SSE2.
+ *
+ * @return Number of characters written to *out*.
+ */
+C64_LOCAL size_t transcode_block(C64_Transcoder *tc, const unsigned char *in, size_t len, char *out)
+{
+   const unsigned char *end = in + len;
+   char *ptr = out;
+   short mapped;
+
+   while (in < end)
+   {
+#ifdef C64_X86
+      while (end - in >= 16
+             && (!tc->line_chars || tc->line_chars - tc->column >= 16)
+             && transcode_16(tc, in, ptr))
+      {
+         in += 16;
+         ptr += 16;
+         tc->count += 16;
+         if (tc->line_chars && (tc->column += 16) == tc->line_chars)
+         {
+            *ptr++ = '\r';
+            *ptr++ = '\n';
+            tc->column = 0;
+         }
+      }
+
+      if (in == end)
+         break;
+#endif
+
+      mapped = tc->map[*in++];
+      if (mapped < C64_MAP_PADDING)
+      {
+         ptr = transcode_put(tc, ptr, (char)mapped);
+         ++tc->count;
+      }
+      else if (mapped == C64_MAP_PADDING)
+         ptr = transcode_pad(tc, ptr);
+   }
+
+   return ptr - out;
+}
+
+/**
+ * @brief Returns a buffer size that is sufficient to transcode
+ *        *input_size* characters, including a terminating NULL.
+ *
+ * A worst case assumes that every other input character is
+ * padding that expands to complete a group.
+ */
+C64_API size_t c64_transcode_chars_needed(size_t input_size, unsigned int breaks)
+{
+   size_t chars = input_size * 2 + 3;
+   unsigned int line_chars = line_chars_from_breaks(breaks, 4);
+
+   if (line_chars)
+      chars += (chars / line_chars + 1) * 2;
+
+   return chars + 1;
+}
+
+/**
+ * @brief Translate encoded text to another set of special characters
+ *        without decoding it.
+ *
+ * The characters for values 62 and 63 are replaced, padding is added
+ * or removed according to the target, and the output is wrapped at
+ * *breaks* characters per line.  Whitespace and other characters that
+ * are not in the source alphabet are discarded.  This function does
+ * not use or change the special characters set by
+ * **c64_set_special_chars**.
+ *
+ * @param from_specials  2- or 3-character special characters string, in
+ *                       the form used by **c64_set_special_chars**, of
+ *                       the input.
+ * @param to_specials    Special characters string of the output.
+ * @param breaks         Characters per output line, 0 for no breaks.
+ *
+ * @return Number of characters written to *buffer*, not including the
+ *         terminating NULL.
+ */
+C64_API size_t c64_transcode_to_buffer(const char *input, size_t len, char *buffer, size_t bufflen,
+                                       const char *from_specials, const char *to_specials,
+                                       unsigned int breaks)
+{
+   assert(bufflen >= c64_transcode_chars_needed(len, breaks));
+
+   C64_Transcoder tc;
+   init_transcoder(&tc, from_specials, to_specials, breaks);
+
+   char *ptr = buffer;
+   ptr += transcode_block(&tc, (const unsigned char*)input, len, ptr);
+   ptr = transcode_pad(&tc, ptr);
+   *ptr = '\0';
+
+   return ptr - buffer;
+}
+
+/**
+ * @brief Stream version of **c64_transcode_to_buffer**.
+ *
+ * @return 0 on success, -1 if reading *in* or writing *out* fails.
+ */
+C64_API int c64_transcode_stream_to_stream(FILE *in, FILE *out,
+                                            const char *from_specials, const char *to_specials,
+                                            unsigned int breaks)
+{
+   unsigned char inbuff[C64_BLOCK_SIZE];
+   // Worst case of padding and line breaks, see c64_transcode_chars_needed:
+   char outbuff[C64_BLOCK_SIZE * 6 + 16];
+
+   C64_Transcoder tc;
+   init_transcoder(&tc, from_specials, to_specials, breaks);
+
+   size_t bytes_read, bytes_written;
+
+   while ((bytes_read = fread(inbuff, 1, sizeof(inbuff), in)) > 0)
+   {
+      bytes_written = transcode_block(&tc, inbuff, bytes_read, outbuff);
+      if (fwrite(outbuff, 1, bytes_written, out) != bytes_written)
+         return -1;
+   }
+
+   bytes_written = transcode_pad(&tc, outbuff) - outbuff;
+   if (fwrite(outbuff, 1, bytes_written, out) != bytes_written)
+      return -1;
+
+   return ferror(in) || fflush(out) ? -1 : 0;
+}
+
+/**
+ * @brief State for **c64_extract_blocks**, collecting the decoded data
+ *        of the current block to pass to the callback in large pieces.
+ */
+typedef struct _C64_Extractor
+{
+   Block_User callback;
+   void *user_data;
+   const C64_Codec *codec;
+   char label[256];
+   C64_Decode_State state;
+   size_t buffered;
+   unsigned char buffer[C64_BLOCK_SIZE + 16];
+} C64_Extractor;
+
+C64_LOCAL void extract_flush(C64_Extractor *ex)
+{
+   if (ex->buffered)
+   {
+      (*ex->callback)(ex->user_data, C64_BLOCK_DATA, ex->label, ex->buffer, ex->buffered);
+      ex->buffered = 0;
+   }
+}
+
+C64_LOCAL void extract_begin(C64_Extractor *ex, const char *label, size_t len)
+{
+   if (len >= sizeof(ex->label))
+      len = sizeof(ex->label) - 1;
+
+   memcpy(ex->label, label, len);
+   ex->label[len] = '\0';
+
+   ex->state.bits = 0;
+   ex->state.count = 0;
+   ex->buffered = 0;
+
+   (*ex->callback)(ex->user_data, C64_BLOCK_BEGIN, ex->label, NULL, 0);
+}
+
+C64_LOCAL void extract_line(C64_Extractor *ex, const char *line, size_t len)
+{
+   size_t chunk;
+
+   while (len > 0)
+   {
+      chunk = len < C64_BLOCK_SIZE / 2 ? len : C64_BLOCK_SIZE / 2;
+
+      if (ex->buffered + chunk > C64_BLOCK_SIZE)
+         extract_flush(ex);
+
+      ex->buffered += decode_groups(ex->codec, (const unsigned char*)line, chunk,
+                                    ex->buffer + ex->buffered, &ex->state);
+      line += chunk;
+      len -= chunk;
+   }
+}
+
+C64_LOCAL void extract_end(C64_Extractor *ex)
+{
+   ex->buffered += flush_group(ex->codec, &ex->state, ex->buffer + ex->buffered);
+   extract_flush(ex);
+   (*ex->callback)(ex->user_data, C64_BLOCK_END, ex->label, NULL, 0);
+}
+
+/**
+ * @brief Case-insensitive search for *needle* in the first *len* chars of *line*.
+ */
+C64_LOCAL const char *find_nocase(const char *line, size_t len, const char *needle)
+{
+   size_t nlen = strlen(needle);
+
+   for (const char *ptr = line; ptr + nlen <= line + len; ++ptr)
+      if (0 == strncasecmp(ptr, needle, nlen))
+         return ptr;
+
+   return NULL;
+}
+
+/**
+ * @brief Copy a MIME parameter value (after *name*) from a header line to *label*.
+ *
+ * @return 1 if the parameter was found, otherwise 0.
+ */
+C64_LOCAL int get_header_param(const char *line, size_t len, const char *name, char *label, size_t label_len)
+{
+   const char *value = find_nocase(line, len, name);
+   if (!value)
+      return 0;
+
+   value += strlen(name);
+
+   const char *end = line + len;
+   const char *stop;
+
+   if (value < end && *value == '"')
+   {
+      ++value;
+      for (stop = value; stop < end && *stop != '"'; ++stop)
+         ;
+   }
+   else
+      for (stop = value; stop < end && *stop != ';' && !isspace((unsigned char)*stop); ++stop)
+         ;
+
+   size_t copy = stop - value;
+   if (copy >= label_len)
+      copy = label_len - 1;
+
+   memcpy(label, value, copy);
+   label[copy] = '\0';
+
+   return copy > 0;
+}
+
+/**
+ * @brief Find and decode every base64 block of a PEM bundle or a MIME
+ *        message in one pass.
+ *
+ * PEM blocks are the lines between "-----BEGIN label-----" and
+ * "-----END label-----".  PEM header lines, like "Proc-Type:", are
+ * skipped.  MIME blocks are the bodies of parts with a
+ * "Content-Transfer-Encoding: base64" header, ending at the next line
+ * that begins with "--", the boundary line.  The label of a MIME block
+ * is the filename or name parameter of its headers, or "part".
+ *
+ * For each block, *callback* is called with C64_BLOCK_BEGIN, then with
+ * C64_BLOCK_DATA for each piece of decoded data, then with C64_BLOCK_END.
+ * The blocks are decoded with the special characters set by
+ * **c64_set_special_chars**.
+ *
+ * @return Number of blocks found.
+ */
+C64_API unsigned int c64_extract_blocks(FILE *in, Block_User callback, void *user_data)
+{
+   enum { Scan_Headers, Scan_Text, Scan_Pem, Scan_Mime } mode = Scan_Headers;
+
+   C64_Extractor extractor;
+   C64_Extractor *ex = &extractor;
+   ex->callback = callback;
+   ex->user_data = user_data;
+   ex->codec = prepare_codec(&base64_codec);
+
+   char mime_label[256] = "";
+   int mime_base64 = 0;
+   unsigned int blocks = 0;
+
+   char *line = NULL;
+   size_t line_size = 0;
+   ssize_t line_len;
+
+   while ((line_len = getline(&line, &line_size, in)) != -1)
+   {
+      // Length without the line terminator, for comparisons:
+      size_t len = line_len;
+      while (len && (line[len-1] == '\n' || line[len-1] == '\r'))
+         --len;
+
+      if (mode == Scan_Pem)
+      {
+         if (0 == strncmp(line, "-----END ", 9))
+         {
+            extract_end(ex);
+            ++blocks;
+            mode = Scan_Text;
+         }
+         else if (!memchr(line, ':', len))
+            extract_line(ex, line, len);
+      }
+      else if (mode == Scan_Mime)
+      {
+         if (0 == strncmp(line, "--", 2))
+         {
+            extract_end(ex);
+            ++blocks;
+            mode = Scan_Headers;
+            mime_base64 = 0;
+            mime_label[0] = '\0';
+         }
+         else
+            extract_line(ex, line, len);
+      }
+      else if (0 == strncmp(line, "-----BEGIN ", 11) && len > 16
+               && 0 == strncmp(line + len - 5, "-----", 5))
+      {
+         extract_begin(ex, line + 11, len - 16);
+         mode = Scan_Pem;
+      }
+      else if (mode == Scan_Headers)
+      {
+         if (len == 0)
+         {
+            if (mime_base64)
+            {
+               if (mime_label[0])
+                  extract_begin(ex, mime_label, strlen(mime_label));
+               else
+                  extract_begin(ex, "part", 4);
+               mode = Scan_Mime;
+            }
+            else
+               mode = Scan_Text;
+         }
+         else if (0 == strncasecmp(line, "Content-Transfer-Encoding:", 26))
+            mime_base64 = find_nocase(line, len, "base64") != NULL;
+         else if (!get_header_param(line, len, "filename=", mime_label, sizeof(mime_label))
+                  && !mime_label[0])
+            get_header_param(line, len, "name=", mime_label, sizeof(mime_label));
+      }
+      else if (0 == strncmp(line, "--", 2))
+      {
+         mode = Scan_Headers;
+         mime_base64 = 0;
+         mime_label[0] = '\0';
+      }
+   }
+
+   // Close a block truncated by the end of the input:
+   if (mode == Scan_Pem || mode == Scan_Mime)
+   {
+      extract_end(ex);
+      ++blocks;
+   }
+
+   free(line);
+
+   return blocks;
+}
+
+/**
+ * @brief Decode from *offset* of encoded input, discarding the first
+ *        *skip* decoded bytes and writing up to *count* bytes.
+ *
+ * @param offset  Input position of the first character of a group.
+ * @param count   Number of bytes to write, or -1 to decode to the end.
+ *
+ * @return 0 on success, -1 if *in* cannot seek to *offset*, or if
+ *         reading *in* or writing *out* fails.
+ */
+C64_LOCAL int decode_span(FILE *in, FILE *out, off_t offset, off_t skip, off_t count)
+{
+   const C64_Codec *codec = prepare_codec(&base64_codec);
+   unsigned char inbuff[C64_BLOCK_SIZE];
+   unsigned char outbuff[C64_BLOCK_SIZE + 16];
+
+   C64_Decode_State state = { 0, 0 };
+   size_t bytes_read, bytes_decoded;
+   unsigned char *ptr;
+   int finished = 0;
+
+   if (fseeko(in, offset, SEEK_SET))
+      return -1;
+
+   while (count != 0 && !finished)
+   {
+      if ((bytes_read = fread(inbuff, 1, sizeof(inbuff), in)) > 0)
+         bytes_decoded = decode_groups(codec, inbuff, bytes_read, outbuff, &state);
+      else
+      {
+         bytes_decoded = flush_group(codec, &state, outbuff);
+         finished = 1;
+      }
+
+      ptr = outbuff;
+      if (skip)
+      {
+         off_t skipped = skip < (off_t)bytes_decoded ? skip : (off_t)bytes_decoded;
+         ptr += skipped;
+         bytes_decoded -= skipped;
+         skip -= skipped;
+      }
+
+      if (count > 0 && (off_t)bytes_decoded > count)
+         bytes_decoded = count;
+
+      if (fwrite(ptr, 1, bytes_decoded, out) != bytes_decoded)
+         return -1;
+
+      if (count > 0)
+         count -= bytes_decoded;
+   }
+
+   return ferror(in) || fflush(out) ? -1 : 0;
+}
+
+/**
+ * @brief Decode only bytes [*first*, *last*) of the original data from
+ *        fixed-width encoded input, without decoding what precedes them.
+ *
+ * The line width and terminator (LF or CRLF) are taken from the first
+ * line, as written by **c64_encode_stream_to_stream**, which locates
+ * the first needed group by arithmetic.  Input without a line break in
+ * its first 64 KB is treated as a single line.  Use **c64_build_index**
+ * and **c64_decode_range_indexed** for input with irregular lines.
+ *
+ * @param in    Seekable stream of encoded input.
+ * @param last  End of the range, or -1 to decode to the end of the data.
+ *
+ * @return 0 on success, -1 if *in* cannot seek, if the line breaks
+ *         are not where the first line says they should be, or if
+ *         reading *in* or writing *out* fails.
+ */
+C64_API int c64_decode_range(FILE *in, FILE *out, off_t first, off_t last)
+{
+   off_t width = 0;
+   int terminator = 0;
+   int chr, prev = 0;
+
+   if (first < 0 || (last >= 0 && last < first))
+      return -1;
+
+   if (fseeko(in, 0, SEEK_SET))
+      return -1;
+
+   while ((chr = getc(in)) != EOF && chr != '\n' && width < 65536)
+   {
+      prev = chr;
+      ++width;
+   }
+
+   if (chr == '\n')
+   {
+      terminator = 1;
+      if (prev == '\r')
+      {
+         --width;
+         ++terminator;
+      }
+   }
+   else
+      width = 0;
+
+   off_t chars = first / 3 * 4;
+   off_t offset = chars;
+
+   if (width)
+   {
+      off_t line_start = chars / width * (width + terminator);
+      offset = line_start + chars % width;
+
+      // Confirm that the line before the target line ends where expected:
+      if (line_start > 0)
+      {
+         if (fseeko(in, line_start - 1, SEEK_SET) || getc(in) != '\n')
+            return -1;
+      }
+   }
+
+   return decode_span(in, out, offset, first % 3, last < 0 ? -1 : last - first);
+}
+
+/** Identifies an index file written by **c64_build_index**. */
+static const char index_magic[8] = { 'C', '6', '4', 'I', 'N', 'D', 'E', 'X' };
+
+/** An index entry: the input offset of the group that decodes to byte *decoded*. */
+typedef struct _C64_Index_Entry
+{
+   uint64_t decoded;
+   uint64_t offset;
+} C64_Index_Entry;
+
+/**
+ * @brief Write a sidecar index of encoded input for **c64_decode_range_indexed**.
+ *
+ * The index maps a decoded position at least every *interval* bytes to
+ * the input offset of its group, so it works with any line layout and
+ * with whitespace or other skipped characters anywhere.  The index file
+ * is a 16-byte header followed by 16-byte entries, in host byte order.
+ *
+ * @param interval  Decoded bytes between entries, rounded down to a
+ *                  multiple of 3.
+ *
+ * @return Number of entries written, or -1 if *in* cannot be rewound
+ *         or read, or writing *index* fails.
+ */
+C64_API off_t c64_build_index(FILE *in, FILE *index, unsigned int interval)
+{
+   const unsigned char *table = prepare_codec(&base64_codec)->table;
+   unsigned char inbuff[C64_BLOCK_SIZE];
+   size_t bytes_read;
+
+   uint64_t step = interval < 3 ? 3 : interval / 3 * 3;
+   uint64_t next_mark = 0;
+   uint64_t decoded = 0;
+   off_t offset = 0;
+   off_t entries = 0;
+   int count = 0;
+
+   if (fseeko(in, 0, SEEK_SET))
+      return -1;
+
+   if (fwrite(index_magic, 1, sizeof(index_magic), index) != sizeof(index_magic)
+       || fwrite(&step, sizeof(step), 1, index) != 1)
+      return -1;
+
+   while ((bytes_read = fread(inbuff, 1, sizeof(inbuff), in)) > 0)
+   {
+      const unsigned char *ptr = inbuff;
+      const unsigned char *end = inbuff + bytes_read;
+
+      while (ptr < end)
+      {
+         // Skip whole groups of digits between index marks:
+         while (count == 0 && decoded < next_mark && end - ptr >= 4
+                && !((table[ptr[0]] | table[ptr[1]] | table[ptr[2]] | table[ptr[3]]) & 0xC0))
+         {
+            ptr += 4;
+            decoded += 3;
+         }
+
+         if (ptr == end)
+            break;
+
+         unsigned char val = table[*ptr];
+         if (val < C64_PADDING)
+         {
+            if (count == 0 && decoded >= next_mark)
+            {
+               C64_Index_Entry entry = { decoded, offset + (ptr - inbuff) };
+               if (fwrite(&entry, sizeof(entry), 1, index) != 1)
+                  return -1;
+               ++entries;
+               next_mark = decoded - decoded % step + step;
+            }
+
+            if (++count == 4)
+            {
+               decoded += 3;
+               count = 0;
+            }
+         }
+         else if (val == C64_PADDING)
+         {
+            decoded += count * 6 / 8;
+            count = 0;
+         }
+
+         ++ptr;
+      }
+
+      offset += bytes_read;
+   }
+
+   return ferror(in) || fflush(index) ? -1 : entries;
+}
+
+/**
+ * @brief Decode bytes [*first*, *last*) of the original data using a
+ *        sidecar index written by **c64_build_index**.
+ *
+ * @param last  End of the range, or -1 to decode to the end of the data.
+ *
+ * @return 0 on success, -1 if the index is invalid, a stream cannot seek,
+ *         or reading *in* or writing *out* fails.
+ */
+C64_API int c64_decode_range_indexed(FILE *in, FILE *index, FILE *out, off_t first, off_t last)
+{
+   char magic[sizeof(index_magic)];
+   uint64_t step;
+   C64_Index_Entry entry;
+
+   if (first < 0 || (last >= 0 && last < first))
+      return -1;
+
+   if (fseeko(index, 0, SEEK_SET)
+       || fread(magic, 1, sizeof(magic), index) != sizeof(magic)
+       || memcmp(magic, index_magic, sizeof(magic))
+       || fread(&step, sizeof(step), 1, index) != 1
+       || fseeko(index, 0, SEEK_END))
+      return -1;
+
+   off_t header = sizeof(magic) + sizeof(step);
+   off_t entries = (ftello(index) - header) / (off_t)sizeof(entry);
+
+   // Binary search for the last entry at or before *first*:
+   off_t low = 0, high = entries - 1, found = -1;
+   while (low <= high)
+   {
+      off_t mid = low + (high - low) / 2;
+      if (fseeko(index, header + mid * (off_t)sizeof(entry), SEEK_SET)
+          || fread(&entry, sizeof(entry), 1, index) != 1)
+         return -1;
+
+      if ((off_t)entry.decoded <= first)
+      {
+         found = mid;
+         low = mid + 1;
+      }
+      else
+         high = mid - 1;
+   }
+
+   if (found < 0
+       || fseeko(index, header + found * (off_t)sizeof(entry), SEEK_SET)
+       || fread(&entry, sizeof(entry), 1, index) != 1)
+      return -1;
+
+   return decode_span(in, out, entry.offset, first - entry.decoded, last < 0 ? -1 : last - first);
+}
+
+/**
+ * @brief Table for the software CRC32C, Castagnoli polynomial
+ *        0x1EDC6F41 in reversed bit order.
+ */
+static uint32_t crc32c_table[256];
+static pthread_once_t crc32c_table_once = PTHREAD_ONCE_INIT;
+
+C64_LOCAL void build_crc32c_table(void)
+{
+   for (uint32_t i=0; i < 256; ++i)
+   {
+      uint32_t crc = i;
+      for (int bit=0; bit < 8; ++bit)
+         crc = (crc >> 1) ^ (0x82F63B78 & -(crc & 1));
+      crc32c_table[i] = crc;
+   }
+}
+
+C64_LOCAL uint32_t crc32c_software(uint32_t crc, const unsigned char *data, size_t len)
+{
+   // Built by the first thread to get here, while any others wait:
+   pthread_once(&crc32c_table_once, build_crc32c_table);
+
+   while (len--)
+      crc = crc32c_table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+
+   return crc;
+}
+
+#ifdef C64_X86
+/**
+ * @brief CRC32C using the SSE4.2 crc32 instruction, 8 bytes at a time.
+ *
+ * Only called after **c64_crc32c** confirms CPU support at runtime.
+ */
+C64_LOCAL __attribute__((target("sse4.2")))
+uint32_t crc32c_sse42(uint32_t crc, const unsigned char *data, size_t len)
+{
+   uint64_t crc64 = crc;
+   uint64_t chunk;
+
+   while (len >= sizeof(chunk))
+   {
+      memcpy(&chunk, data, sizeof(chunk));
+      crc64 = _mm_crc32_u64(crc64, chunk);
+      data += sizeof(chunk);
+      len -= sizeof(chunk);
+   }
+
+   crc = (uint32_t)crc64;
+   while (len--)
+      crc = _mm_crc32_u8(crc, *data++);
+
+   return crc;
+}
+#endif
+
+/**
+ * @brief Compute or continue a CRC32C (Castagnoli) checksum.
+ *
+ * Uses the SSE4.2 crc32 instruction if the CPU supports it, otherwise
+ * a table-driven software implementation.  Like zlib's **crc32()**,
+ * start with a *crc* of 0 and pass the result of the previous call to
+ * continue the checksum across several buffers.
+ *
+ * @return The updated checksum.
+ */
+C64_API uint32_t c64_crc32c(uint32_t crc, const void *data, size_t len)
+{
+   const unsigned char *bytes = (const unsigned char*)data;
+
+   crc = ~crc;
+
+#ifdef C64_X86
+   if (__builtin_cpu_supports("sse4.2"))
+      crc = crc32c_sse42(crc, bytes, len);
+   else
+#endif
+      crc = crc32c_software(crc, bytes, len);
+
+   return ~crc;
+}
@@ -0,0 +1,175 @@
+// -*- compile-command: "cc -Wall -Werror -O2 -o runstat runstat.c" -*-
+
+/**
+ * runstat: run a command and report its elapsed time, peak resident
+ * set size, and optionally the number of system calls it made.
+ *
+ * This is the measuring end of throughput.sh.  It needs neither
+ * /usr/bin/time nor strace, which are often missing from build hosts.
+ * The command's standard streams are left alone so that it can be in
+ * the middle of a pipeline, and the report is written to a file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>     // strerror()
+#include <errno.h>
+#include <signal.h>
+#include <time.h>       // clock_gettime()
+#include <unistd.h>     // fork(), execvp()
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+void show_usage(void)
+{
+   printf("runstat [-s] -o report_file command [arguments]\n");
+   printf("-o filename Write \"elapsed_ns max_rss_kb syscalls\" to filename.\n");
+   printf("-s count the system calls of the command and all of its threads.\n");
+   printf("   The count is reported as - without -s or if tracing is not permitted.\n");
+   printf("   Tracing slows the command, so measure time and system calls in separate runs.\n");
+}
+
+/**
+ * @brief Follow a traced command until it exits, counting the
+ *        system-call stops of all of its threads.
+ *
+ * Every system call stops a thread twice, at entry and at exit, except
+ * for the exit_group that ends the command.
+ *
+ * @return Number of system calls, or -1 if the command could not be traced.
+ */
+long count_syscalls(pid_t pid, int *status, struct rusage *usage)
+{
+   long stops = 0;
+   pid_t tid;
+
+   // The child stops itself with SIGSTOP before calling exec:
+   if (wait4(pid, status, 0, usage) < 0 || !WIFSTOPPED(*status))
+      return -1;
+
+   if (ptrace(PTRACE_SETOPTIONS, pid, 0,
+              PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_TRACEEXEC
+                 | PTRACE_O_EXITKILL) < 0)
+   {
+      ptrace(PTRACE_DETACH, pid, 0, 0);
+      wait4(pid, status, 0, usage);
+      return -1;
+   }
+
+   ptrace(PTRACE_SYSCALL, pid, 0, 0);
+
+   while ((tid = wait4(-1, status, __WALL, usage)) > 0)
+   {
+      int deliver = 0;
+
+      if (WIFEXITED(*status) || WIFSIGNALED(*status))
+      {
+         if (tid == pid)
+            break;
+         continue;
+      }
+
+      if (WSTOPSIG(*status) == (SIGTRAP | 0x80))
+         ++stops;
+      else if (*status >> 16 == 0 && WSTOPSIG(*status) != SIGSTOP)
+         // A signal for the command rather than a ptrace event:
+         deliver = WSTOPSIG(*status);
+
+      ptrace(PTRACE_SYSCALL, tid, 0, deliver);
+   }
+
+   return (stops + 1) / 2;
+}
+
+int main(int argc, char **argv)
+{
+   const char *report_filename = NULL;
+   int trace = 0;
+   int arg = 1;
+
+   for (; arg < argc && argv[arg][0] == '-'; ++arg)
+   {
+      switch (argv[arg][1])
+      {
+         case 's':
+            trace = 1;
+            break;
+         case 'o':
+            if (++arg < argc)
+               report_filename = argv[arg];
+            break;
+         case 'h':
+            show_usage();
+            return 0;
+         default:
+            show_usage();
+            return 1;
+      }
+   }
+
+   if (arg == argc || !report_filename)
+   {
+      show_usage();
+      return 1;
+   }
+
+   FILE *report = fopen(report_filename, "w");
+   if (!report)
+   {
+      fprintf(stderr, "Failed to open report file \"%s\" (%s).\n", report_filename, strerror(errno));
+      return 1;
+   }
+
+   struct timespec start, finish;
+   struct rusage usage;
+   long syscalls = -1;
+   int status = 0;
+   pid_t waited = 0;
+
+   clock_gettime(CLOCK_MONOTONIC, &start);
+
+   pid_t pid = fork();
+   if (pid < 0)
+   {
+      fprintf(stderr, "Failed to start \"%s\" (%s).\n", argv[arg], strerror(errno));
+      fclose(report);
+      return 1;
+   }
+   else if (pid == 0)
+   {
+      fclose(report);
+      if (trace && ptrace(PTRACE_TRACEME, 0, 0, 0) == 0)
+         raise(SIGSTOP);
+
+      execvp(argv[arg], &argv[arg]);
+      fprintf(stderr, "Failed to run \"%s\" (%s).\n", argv[arg], strerror(errno));
+      _exit(127);
+   }
+
+   if (trace)
+      syscalls = count_syscalls(pid, &status, &usage);
+
+   // Not traced, or tracing was refused and the command runs untraced:
+   if (syscalls < 0)
+   {
+      do
+         waited = wait4(pid, &status, 0, &usage);
+      while (waited == pid && !WIFEXITED(status) && !WIFSIGNALED(status));
+   }
+
+   clock_gettime(CLOCK_MONOTONIC, &finish);
+
+   long long elapsed = (finish.tv_sec - start.tv_sec) * 1000000000LL + (finish.tv_nsec - start.tv_nsec);
+
+   if (syscalls < 0)
+      fprintf(report, "%lld %ld -\n", elapsed, usage.ru_maxrss);
+   else
+      fprintf(report, "%lld %ld %ld\n", elapsed, usage.ru_maxrss, syscalls);
+
+   fclose(report);
+
+   if (WIFEXITED(status))
+      return WEXITSTATUS(status);
+   return 128 + (WIFSIGNALED(status) ? WTERMSIG(status) : 0);
+}
@@ -0,0 +1,203 @@
+#!/bin/bash
+#
+# End-to-end throughput of the code64 command across input kinds,
+# sizes, and I/O modes.  Run with "make throughput", or directly:
+#
+#    SIZES="1K 1M 1G" KINDS="random mime" MODES="stdio pipe" ./throughput.sh
+#
+# Environment:
+#    SIZES     Sizes of the unencoded test data, with K, M, or G suffixes.
+#    KINDS     Input kinds: random (binary to encode), and mime, pem,
+#              and base64url (pre-encoded text to decode).
+#    MODES     I/O modes: stdio (named files), pipe (stdin to stdout),
+#              threaded (-j 0), and mmap and large if code64 supports
+#              --mmap and --large.
+#    WORKDIR   Directory for the test files, removed when done unless
+#              KEEP is set.
+#    SYSCALLS  Set to 0 to skip the second, traced run of each
+#              conversion that counts its system calls.
+#
+# Each conversion is checked by converting its output back and
+# comparing the result to the original with cmp.  Throughput is the
+# size of the conversion's input divided by its elapsed time, which
+# includes starting the process.
+
+SIZES=${SIZES:-"1K 64K 1M 16M 256M"}
+KINDS=${KINDS:-"random mime pem base64url"}
+WORKDIR=${WORKDIR:-${TMPDIR:-/tmp}/code64-throughput}
+SYSCALLS=${SYSCALLS:-1}
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+CODE64="$HERE/code64"
+RUNSTAT="$HERE/runstat"
+
+export LD_LIBRARY_PATH="$HERE${LD_LIBRARY_PATH:+:$LD_LIBRARY_PATH}"
+
+if [ ! -x "$CODE64" ] || [ ! -x "$RUNSTAT" ]; then
+   echo "Build code64 and runstat first (make code64 runstat)." >&2
+   exit 1
+fi
+
+if [ -z "$MODES" ]; then
+   MODES="stdio pipe threaded"
+   if "$CODE64" -h | grep -q -- "--mmap"; then
+      MODES="$MODES mmap"
+   fi
+   if "$CODE64" -h | grep -q -- "--large"; then
+      MODES="$MODES large"
+   fi
+fi
+
+# Convert a size like 64K or 2G to bytes.
+size_bytes()
+{
+   local number=${1%[KMGkmg]}
+   case $1 in
+      *[Kk]) echo $(( number * 1024 )) ;;
+      *[Mm]) echo $(( number * 1024 * 1024 )) ;;
+      *[Gg]) echo $(( number * 1024 * 1024 * 1024 )) ;;
+      *)     echo "$number" ;;
+   esac
+}
+
+# Options that select a kind's standard for code64.
+kind_options()
+{
+   case $1 in
+      mime)      echo "-s mime" ;;
+      pem)       echo "-s pem" ;;
+      base64url) echo "-s base64url" ;;
+      *)         echo "" ;;
+   esac
+}
+
+# Run code64 with the options in $2 on file $3 to file $4 in mode $1,
+# leaving "elapsed_ns max_rss_kb syscalls" in $WORKDIR/report.
+# Returns the exit status of code64.
+run_mode()
+{
+   local mode=$1 options=$2 input=$3 output=$4
+   local status trace_report="$WORKDIR/report.trace"
+
+   run_once()
+   {
+      case $mode in
+         stdio)    "$RUNSTAT" "$@" "$CODE64" $options -i "$input" -o "$output" ;;
+         threaded) "$RUNSTAT" "$@" "$CODE64" $options -j 0 -i "$input" -o "$output" ;;
+         mmap)     "$RUNSTAT" "$@" "$CODE64" $options --mmap -i "$input" -o "$output" ;;
+         large)    "$RUNSTAT" "$@" "$CODE64" $options --large -i "$input" -o "$output" ;;
+         pipe)     cat "$input" | "$RUNSTAT" "$@" "$CODE64" $options | cat > "$output"
+                   # The status of runstat, not of the last cat:
+                   return "${PIPESTATUS[1]}" ;;
+      esac
+   }
+
+   run_once -o "$WORKDIR/report" 2>/dev/null
+   status=$?
+
+   if [ "$SYSCALLS" != 0 ] && [ $status -eq 0 ]; then
+      run_once -s -o "$trace_report" 2>/dev/null
+      read -r _ _ syscalls < "$trace_report"
+      read -r elapsed rss _ < "$WORKDIR/report"
+      echo "$elapsed $rss $syscalls" > "$WORKDIR/report"
+   fi
+
+   return $status
+}
+
+# Verdict of the first conversion of a round trip, from its status $1.
+step_verdict()
+{
+   if [ "$1" -eq 0 ]; then
+      echo "-"
+   else
+      echo "FAILED"
+   fi
+}
+
+# Print a row of results for one conversion.
+report()
+{
+   local kind=$1 size=$2 mode=$3 operation=$4 bytes=$5 verdict=$6
+   local elapsed rss syscalls mbps
+
+   read -r elapsed rss syscalls < "$WORKDIR/report"
+   if [ "$elapsed" -gt 0 ]; then
+      mbps=$(( bytes * 1000 / elapsed ))
+   else
+      mbps=0
+   fi
+
+   printf "%-10s %6s %-9s %-7s %10s %10s %9s  %s\n" \
+          "$kind" "$size" "$mode" "$operation" "$mbps" "$rss" "$syscalls" "$verdict"
+}
+
+mkdir -p "$WORKDIR" || exit 1
+
+failures=0
+
+printf "%-10s %6s %-9s %-7s %10s %10s %9s  %s\n" \
+       kind size mode op "MB/s" "rss KB" syscalls check
+
+for size in $SIZES; do
+   bytes=$(size_bytes "$size")
+   raw="$WORKDIR/raw-$size"
+   head -c "$bytes" /dev/urandom > "$raw"
+
+   for kind in $KINDS; do
+      options=$(kind_options "$kind")
+
+      if [ "$kind" = random ]; then
+         source="$raw"
+         first=Encode
+      else
+         # Pre-encoded input, made with the single-threaded encoder:
+         source="$WORKDIR/$kind-$size.txt"
+         "$CODE64" $options -i "$raw" -o "$source" 2>/dev/null
+         first=Decode
+      fi
+
+      for mode in $MODES; do
+         converted="$WORKDIR/converted"
+         restored="$WORKDIR/restored"
+
+         if [ $first = Encode ]; then
+            run_mode "$mode" "$options -e" "$source" "$converted"
+            step1=$?
+            report "$kind" "$size" "$mode" encode "$(stat -c %s "$source")" "$(step_verdict $step1)"
+            run_mode "$mode" "$options -d" "$converted" "$restored"
+            step2=$?
+            second=decode
+         else
+            run_mode "$mode" "$options -d" "$source" "$converted"
+            step1=$?
+            report "$kind" "$size" "$mode" decode "$(stat -c %s "$source")" "$(step_verdict $step1)"
+            run_mode "$mode" "$options -e" "$converted" "$restored"
+            step2=$?
+            second=encode
+         fi
+
+         if [ $step1 -eq 0 ] && [ $step2 -eq 0 ] && cmp -s "$source" "$restored"; then
+            verdict="round trip ok"
+         else
+            verdict="ROUND TRIP FAILED"
+            failures=$(( failures + 1 ))
+         fi
+
+         report "$kind" "$size" "$mode" "$second" "$(stat -c %s "$converted")" "$verdict"
+      done
+
+      [ "$source" != "$raw" ] && rm -f "$source"
+   done
+
+   rm -f "$raw" "$WORKDIR/converted" "$WORKDIR/restored"
+done
+
+if [ -z "$KEEP" ]; then
+   rm -rf "$WORKDIR"
+fi
+
+if [ $failures -gt 0 ]; then
+   echo "$failures round trips failed." >&2
+   exit 1
+fi